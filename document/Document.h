@@ -45,19 +45,21 @@ public:
 	 */
 	inline void setCurrentStrokeStyle(const Style& style) {
 
-		get<Page>(_currentPage).currentStroke().setStyle(style);
+		get<Page>(_currentPage).setCurrentStrokeStyle(style);
 	}
 
 	/**
 	 * Add a new stroke point to the global list and append it to the current 
 	 * stroke.
+	 *
+	 * @return The area that changed by adding the point.
 	 */
-	inline void addStrokePoint(
+	inline util::box<DocumentPrecision,2> addStrokePoint(
 			const util::point<DocumentPrecision,2>& position,
 			double                                pressure,
 			unsigned long                         timestamp) {
 
-		get<Page>(_currentPage).addStrokePoint(position, pressure, timestamp);
+		return get<Page>(_currentPage).addStrokePoint(position, pressure, timestamp);
 	}
 
 	/**
@@ -65,7 +67,7 @@ public:
 	 */
 	inline void finishCurrentStroke() {
 
-		getPage(_currentPage).currentStroke().finish();
+		getPage(_currentPage).finishCurrentStroke();
 	}
 
 	/**
@@ -80,6 +82,17 @@ public:
 		return false;
 	}
 
+	/**
+	 * Get the page that receives new strokes.
+	 */
+	inline const Page& getCurrentPage() const { return get<Page>(_currentPage); }
+
+	/**
+	 * Get the stroke that is currently drawn. Call this only if 
+	 * hasOpenStroke() returns true.
+	 */
+	inline const Stroke& getCurrentStroke() const { return get<Page>(_currentPage).currentStroke(); }
+
 	/**
 	 * Virtually erase points within the given postion and radius by splitting 
 	 * the involved strokes.
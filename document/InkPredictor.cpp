@@ -0,0 +1,106 @@
+#include <cmath>
+
+#include <util/ProgramOptions.h>
+#include "InkPredictor.h"
+
+util::ProgramOption optionInkPrediction(
+		util::_long_name        = "inkPrediction",
+		util::_description_text = "The number of milliseconds to extrapolate the pen position ahead of the last sample, to hide input latency. 0 disables the prediction.",
+		util::_default_value    = 0);
+
+namespace {
+
+inline double
+length(const util::point<double,2>& p) {
+
+	return std::sqrt(p.x()*p.x() + p.y()*p.y());
+}
+
+} // anonymous namespace
+
+InkPredictor::InkPredictor() :
+	_lookAhead(optionInkPrediction.as<double>()) {}
+
+InkPredictor::InkPredictor(double lookAhead) :
+	_lookAhead(lookAhead) {}
+
+bool
+InkPredictor::predict(
+		const StrokePoints& points,
+		unsigned long       begin,
+		unsigned long       end,
+		double              time,
+		StrokePoint&        prediction) const {
+
+	// find the last three samples with strictly decreasing timestamps (several 
+	// samples can arrive with the same timestamp)
+	unsigned long samples[3];
+	unsigned int  numSamples = 0;
+
+	for (unsigned long i = end; i > begin && numSamples < 3; i--)
+		if (numSamples == 0 || points[i - 1].timestamp < points[samples[numSamples - 1]].timestamp)
+			samples[numSamples++] = i - 1;
+
+	if (numSamples < 2)
+		return false;
+
+	const StrokePoint& last     = points[samples[0]];
+	const StrokePoint& previous = points[samples[1]];
+
+	double dt1 = last.timestamp - previous.timestamp;
+	util::point<double,2> velocity = (last.position - previous.position)*(1.0/dt1);
+
+	util::point<double,2> acceleration(0, 0);
+
+	if (numSamples == 3) {
+
+		const StrokePoint& first = points[samples[2]];
+
+		double dt0 = previous.timestamp - first.timestamp;
+		util::point<double,2> previousVelocity = (previous.position - first.position)*(1.0/dt0);
+
+		acceleration = (velocity - previousVelocity)*(2.0/(dt0 + dt1));
+	}
+
+	util::point<double,2> linear = velocity*time;
+	util::point<double,2> curved = acceleration*(0.5*time*time);
+
+	// Acceleration estimates from few noisy samples overshoot easily. Don't 
+	// let the curvature dominate the prediction.
+	double linearLength = length(linear);
+	double curvedLength = length(curved);
+
+	if (curvedLength > 0.5*linearLength)
+		curved *= 0.5*linearLength/curvedLength;
+
+	prediction = StrokePoint(
+			last.position + linear + curved,
+			last.pressure,
+			last.timestamp + static_cast<unsigned long>(std::round(time)));
+
+	return true;
+}
+
+void
+InkPredictor::predictTail(
+		const StrokePoints&       points,
+		unsigned long             begin,
+		unsigned long             end,
+		std::vector<StrokePoint>& tail) const {
+
+	tail.clear();
+
+	if (_lookAhead <= 0)
+		return;
+
+	StrokePoint prediction(util::point<double,2>(0, 0), 0, 0);
+
+	for (unsigned int i = 1; i <= TailLength; i++) {
+
+		if (!predict(points, begin, end, _lookAhead*i/TailLength, prediction))
+			return;
+
+		tail.push_back(prediction);
+	}
+}
+
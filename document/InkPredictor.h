@@ -0,0 +1,77 @@
+#ifndef YANTA_INK_PREDICTOR_H__
+#define YANTA_INK_PREDICTOR_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include "StrokePoint.h"
+#include "StrokePoints.h"
+
+/**
+ * Extrapolates the position of the pen a few milliseconds ahead of the last
+ * sample of a stroke, to hide the latency between pen and display. The
+ * prediction uses the velocity and acceleration (and therefore the curvature)
+ * of the most recent samples, as given by their timestamps (in milliseconds).
+ */
+class InkPredictor {
+
+public:
+
+	/**
+	 * Create a new predictor that looks ahead the number of milliseconds given
+	 * by the program option 'inkPrediction'.
+	 */
+	InkPredictor();
+
+	/**
+	 * Create a new predictor that looks ahead the given number of
+	 * milliseconds.
+	 */
+	InkPredictor(double lookAhead);
+
+	/**
+	 * Set the number of milliseconds to look ahead. Zero disables the
+	 * prediction.
+	 */
+	void setLookAhead(double lookAhead) { _lookAhead = lookAhead; }
+
+	/**
+	 * Get the number of milliseconds to look ahead.
+	 */
+	double getLookAhead() const { return _lookAhead; }
+
+	/**
+	 * Predict the pen for a given time after the last sample of the stroke
+	 * points [begin, end).
+	 *
+	 * @return false, if there are not enough samples for a prediction.
+	 */
+	bool predict(
+			const StrokePoints& points,
+			unsigned long       begin,
+			unsigned long       end,
+			double              time,
+			StrokePoint&        prediction) const;
+
+	/**
+	 * Predict the tail of the stroke points [begin, end) up to the look-ahead
+	 * time. The tail is a sequence of points after the last sample. It is
+	 * empty if the prediction is disabled or there are not enough samples.
+	 */
+	void predictTail(
+			const StrokePoints&       points,
+			unsigned long             begin,
+			unsigned long             end,
+			std::vector<StrokePoint>& tail) const;
+
+private:
+
+	// the number of points to predict for a tail
+	static const unsigned int TailLength = 4;
+
+	// the number of milliseconds to look ahead
+	double _lookAhead;
+};
+
+#endif // YANTA_INK_PREDICTOR_H__
+
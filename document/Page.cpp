@@ -11,12 +11,22 @@ Page::Page(
 	_size(size),
 	_borderSize(15),
 	_pageBoundingBox(position.x(), position.y(), position.x() + size.x(), position.y() + size.y()),
-	_strokePoints(document->getStrokePoints()) {
+	_strokePoints(document->getStrokePoints()),
+	_version(0) {
 
 	fitBoundingBox(util::box<PagePrecision,2>(-getBorderSize(), -getBorderSize(), size.x() + getBorderSize(), size.y() + getBorderSize()));
 	shift(position);
 }
 
+Page::Page(const Page& other) :
+	DocumentElementContainer<Stroke>(other),
+	_size(other._size),
+	_borderSize(other._borderSize),
+	_pageBoundingBox(other._pageBoundingBox),
+	_strokePoints(other._strokePoints),
+	_version(other._version.load()),
+	_renderCache(other.getRenderCache()) {}
+
 Page&
 Page::operator=(const Page& other) {
 
@@ -25,6 +35,7 @@ Page::operator=(const Page& other) {
 
 	_size            = other._size;
 	_pageBoundingBox = other._pageBoundingBox;
+	_version++;
 
 	// we don't copy the stroke points, since they might belong to another 
 	// document
@@ -51,6 +62,7 @@ Page::createNewStroke(unsigned long begin) {
 		currentStroke().finish();
 
 	add(Stroke(begin));
+	_version++;
 }
 
 void
@@ -106,6 +118,9 @@ Page::erase(const util::point<DocumentPrecision,2>& begin, const util::point<Doc
 
 	LOG_ALL(pagelog) << "changed area is " << changedArea << std::endl;
 
+	if (!changedArea.isZero())
+		_version++;
+
 	// transform the changed area to document coordinates
 	return toDocumentCoordinates(changedArea);
 }
@@ -153,6 +168,9 @@ Page::erase(const util::point<PagePrecision,2>& position, PagePrecision radius)
 
 	LOG_ALL(pagelog) << "changed area is " << changedArea << std::endl;
 
+	if (!changedArea.isZero())
+		_version++;
+
 	// transform the changed area to document coordinates
 	return toDocumentCoordinates(changedArea);
 }
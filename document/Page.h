@@ -1,6 +1,9 @@
 #ifndef YANTA_PAGE_H__
 #define YANTA_PAGE_H__
 
+#include <atomic>
+#include <memory>
+
 #include <util/tree.h>
 
 #include "DocumentElementContainer.h"
@@ -8,8 +11,9 @@
 #include "Stroke.h"
 #include "StrokePoints.h"
 
-// forward declaration
+// forward declarations
 class Document;
+class PageRenderCache;
 
 class Page : public DocumentElementContainer<Stroke> {
 
@@ -22,6 +26,8 @@ public:
 			const util::point<DocumentPrecision,2>& position,
 			const util::point<PagePrecision,2>&   size);
 
+	Page(const Page& other);
+
 	Page& operator=(const Page& other);
 
 	/**
@@ -56,13 +62,26 @@ public:
 	/**
 	 * Add a complete stroke to this page.
 	 */
-	void addStroke(const Stroke& stroke) { add(stroke); }
+	void addStroke(const Stroke& stroke) { add(stroke); _version++; }
+
+	/**
+	 * Set the style of the current stroke.
+	 */
+	void setCurrentStrokeStyle(const Style& style) { currentStroke().setStyle(style); _version++; }
+
+	/**
+	 * Finish the current stroke.
+	 */
+	void finishCurrentStroke() { currentStroke().finish(); _version++; }
 
 	/**
 	 * Add a stroke point to the current stroke. This appends the stroke point 
 	 * to the global list of stroke points.
+	 *
+	 * @return The area that changed by adding the point, i.e., the new segment 
+	 *         of the stroke.
 	 */
-	inline void addStrokePoint(
+	inline util::box<DocumentPrecision,2> addStrokePoint(
 			const util::point<DocumentPrecision,2>& position,
 			double                                pressure,
 			unsigned long                         timestamp) {
@@ -75,6 +94,21 @@ public:
 		currentStroke().setEnd(_strokePoints.size(), _strokePoints);
 
 		fitBoundingBox(position);
+
+		// the previous point of the stroke, if there is one
+		util::point<PagePrecision,2> previous = p;
+		if (currentStroke().size() > 1)
+			previous = _strokePoints[_strokePoints.size() - 2].position;
+
+		PagePrecision width = currentStroke().getStyle().width();
+
+		util::box<PagePrecision,2> changedArea(
+				std::min(p.x(), previous.x()) - width,
+				std::min(p.y(), previous.y()) - width,
+				std::max(p.x(), previous.x()) + width,
+				std::max(p.y(), previous.y()) + width);
+
+		return toDocumentCoordinates(changedArea);
 	}
 
 	/**
@@ -128,6 +162,7 @@ public:
 		get<Stroke>().resize(newEnd - get<Stroke>().begin());
 
 		recomputeBoundingBox();
+		_version++;
 
 		return removed;
 	}
@@ -137,6 +172,42 @@ public:
 	 */
 	void recomputeBoundingBox();
 
+	/**
+	 * Get the version of the finished strokes of this page. The version 
+	 * changes whenever strokes are added, removed, finished, or erased, but 
+	 * not when points are added to the open stroke.
+	 */
+	inline unsigned long getVersion() const { return _version; }
+
+	/**
+	 * Get the render cache of this page, if any was set. The cache might be 
+	 * outdated (see PageRenderCache::isValidFor()). Thread safe.
+	 */
+	inline std::shared_ptr<PageRenderCache> getRenderCache() const {
+
+		return std::atomic_load(&_renderCache);
+	}
+
+	/**
+	 * Attach a render cache to this page. Caches are not modified once they 
+	 * are attached, they are replaced. Thread safe.
+	 */
+	inline void setRenderCache(std::shared_ptr<PageRenderCache> cache) const {
+
+		std::atomic_store(&_renderCache, cache);
+	}
+
+	/**
+	 * Attach a render cache to this page, if the currently attached one is 
+	 * still the expected one. Thread safe.
+	 *
+	 * @return false, if another cache was attached in the meantime.
+	 */
+	inline bool replaceRenderCache(std::shared_ptr<PageRenderCache> expected, std::shared_ptr<PageRenderCache> cache) const {
+
+		return std::atomic_compare_exchange_strong(&_renderCache, &expected, cache);
+	}
+
 private:
 
 	struct UpdateBoundingBox {
@@ -216,6 +287,13 @@ private:
 
 	// the global list of stroke points
 	StrokePoints& _strokePoints;
+
+	// the version of the finished strokes, read by the painters of other 
+	// threads
+	std::atomic<unsigned long> _version;
+
+	// recorded drawing commands, owned by the painters
+	mutable std::shared_ptr<PageRenderCache> _renderCache;
 };
 
 #endif // YANTA_PAGE_H__
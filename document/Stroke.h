@@ -1,6 +1,7 @@
 #ifndef STROKE_H__
 #define STROKE_H__
 
+#include <memory>
 #include <vector>
 #include <util/point.hpp>
 #include <util/box.hpp>
@@ -9,6 +10,9 @@
 #include "StrokePoints.h"
 #include "Style.h"
 
+// forward declaration
+class StrokeRenderCache;
+
 class Stroke : public DocumentElement {
 
 public:
@@ -107,6 +111,24 @@ public:
 		return _finished;
 	}
 
+	/**
+	 * Get the render cache of this stroke, if any was set. The cache might be 
+	 * outdated (see StrokeRenderCache::isValidFor()). Thread safe.
+	 */
+	inline std::shared_ptr<StrokeRenderCache> getRenderCache() const {
+
+		return std::atomic_load(&_renderCache);
+	}
+
+	/**
+	 * Attach a render cache to this stroke. Caches are not modified once they 
+	 * are attached, they are replaced. Thread safe.
+	 */
+	inline void setRenderCache(std::shared_ptr<StrokeRenderCache> cache) const {
+
+		std::atomic_store(&_renderCache, cache);
+	}
+
 	/**
 	 * Recompute the bounding box of this stroke.
 	 */
@@ -135,6 +157,9 @@ private:
 	// indices of the stroke points in the global point list
 	unsigned long _begin;
 	unsigned long _end;
+
+	// geometry derived for rendering, owned by the painters
+	mutable std::shared_ptr<StrokeRenderCache> _renderCache;
 };
 
 #endif // STROKE_H__
@@ -1,6 +1,7 @@
 #ifndef YANTA_STROKE_POINTS_H__
 #define YANTA_STROKE_POINTS_H__
 
+#include <cmath>
 #include <vector>
 #include <boost/thread/shared_mutex.hpp>
 
@@ -10,6 +11,11 @@
  * Central collection of all stroke points in a document. Strokes are defined as 
  * begin and end indices into this collection plus an optional transformation.  
  * This way, two strokes can use the same stroke points.
+ *
+ * Along with the points, the cumulative length of the polyline through all 
+ * points is stored, such that the arc length between any two points of a 
+ * stroke can be looked up in constant time. Points must therefore not be 
+ * moved once they were added.
  */
 class StrokePoints {
 
@@ -34,21 +40,37 @@ public:
 	 */
 	inline unsigned long size() const { return _points.size(); }
 
+	/**
+	 * Get the length of the polyline from point begin to point i, i.e., the 
+	 * position of point i along a stroke starting at begin.
+	 */
+	inline double getArcLength(unsigned long begin, unsigned long i) const { return _arcLengths[i] - _arcLengths[begin]; }
+
 	/**
 	 * Add a new stroke point. Will uniquely lock the mutex, if a reallocation 
 	 * is necessary. This method itself is not thread safe.
 	 */
 	inline void add(const StrokePoint& point) {
 
-		if (_points.size() + 1 <= _points.capacity())
+		double arcLength = 0;
+
+		if (!_points.empty()) {
+
+			util::point<double,2> diff = point.position - _points.back().position;
+			arcLength = _arcLengths.back() + std::sqrt(diff.x()*diff.x() + diff.y()*diff.y());
+		}
+
+		if (_points.size() + 1 <= _points.capacity() && _arcLengths.size() + 1 <= _arcLengths.capacity()) {
 
 			_points.push_back(point);
+			_arcLengths.push_back(arcLength);
 
-		else {
+		} else {
 
 			boost::unique_lock<boost::shared_mutex> lock(_mutex);
 
 			_points.push_back(point);
+			_arcLengths.push_back(arcLength);
 		}
 	}
 
@@ -64,6 +86,7 @@ private:
 
 		// we will certainly need a lot of them
 		_points.reserve(10000);
+		_arcLengths.reserve(10000);
 	}
 
 	void copyFrom(StrokePoints& other) {
@@ -71,12 +94,16 @@ private:
 		boost::shared_lock<boost::shared_mutex> lockThem(other._mutex);
 		boost::unique_lock<boost::shared_mutex> lockMe(_mutex);
 
-		_points = other._points;
+		_points     = other._points;
+		_arcLengths = other._arcLengths;
 	}
 
 	boost::shared_mutex _mutex;
 	points_t            _points;
 
+	// the length of the polyline from the first point to each point
+	std::vector<double> _arcLengths;
+
 };
 
 #endif // YANTA_STROKE_POINTS_H__
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <SkBitmap.h>
+
+#include <util/Logger.h>
+#include "BrushStamps.h"
+
+logger::LogChannel brushstampslog("brushstampslog", "[BrushStamps] ");
+
+namespace {
+
+// sizes below this are quantized linearly in steps of 1/LinearSteps pixels, 
+// larger sizes logarithmically with LogSteps steps per doubling
+const double       LinearLimit = 8.0;
+const unsigned int LinearSteps = 4;
+const unsigned int LogSteps    = 16;
+
+// The smallest radius level a stamp is created for. Level 0 would be a disc 
+// of radius 0, which has no ink at all. Thinner discs are drawn with the 
+// smallest stamp instead of vanishing.
+const int MinRadiusLevel = 1;
+
+// the standard deviation of the box filter of a pixel, added to the blur to 
+// anti-alias the edge of the disc
+const double pixelSigma = 0.3;
+
+} // anonymous namespace
+
+const BrushStamps::Stamp&
+BrushStamps::get(double radius, double sigma) {
+
+	std::pair<int,int> key(std::max(toLevel(radius), MinRadiusLevel), toLevel(sigma));
+
+	std::map<std::pair<int,int>, Stamp>::iterator i = _stamps.find(key);
+
+	if (i != _stamps.end())
+		return i->second;
+
+	return _stamps[key] = create(fromLevel(key.first), fromLevel(key.second));
+}
+
+void
+BrushStamps::trim() {
+
+	if (_stamps.size() <= MaxStamps)
+		return;
+
+	LOG_DEBUG(brushstampslog) << "forgetting " << _stamps.size() << " stamps" << std::endl;
+
+	_stamps.clear();
+}
+
+int
+BrushStamps::toLevel(double size) {
+
+	if (size < LinearLimit)
+		return static_cast<int>(std::floor(size*LinearSteps + 0.5));
+
+	return LinearLimit*LinearSteps + static_cast<int>(std::floor(LogSteps*std::log2(size/LinearLimit) + 0.5));
+}
+
+double
+BrushStamps::fromLevel(int level) {
+
+	if (level < LinearLimit*LinearSteps)
+		return static_cast<double>(level)/LinearSteps;
+
+	return LinearLimit*std::pow(2.0, static_cast<double>(level - LinearLimit*LinearSteps)/LogSteps);
+}
+
+BrushStamps::Stamp
+BrushStamps::create(double radius, double sigma) {
+
+	// include the edge up to three standard deviations
+	double s = std::sqrt(sigma*sigma + pixelSigma*pixelSigma);
+	int size = 2*static_cast<int>(std::ceil(radius + 3*s)) + 2;
+
+	LOG_ALL(brushstampslog) << "creating stamp of size " << size << " for radius " << radius << " and sigma " << sigma << std::endl;
+
+	Stamp stamp;
+	stamp.center = 0.5*size;
+
+	std::vector<double> coverage(size*size);
+	double sum = 0;
+
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++) {
+
+			// the distance of the pixel center to the center of the disc
+			double dx = x + 0.5 - stamp.center;
+			double dy = y + 0.5 - stamp.center;
+			double d  = std::sqrt(dx*dx + dy*dy);
+
+			// the coverage of a disc convolved with a Gaussian, in the 
+			// approximation of a straight edge
+			double c = 0.5*std::erfc((d - radius)/(std::sqrt(2.0)*s));
+
+			coverage[y*size + x] = c;
+			sum += c;
+		}
+
+	// The approximation overestimates the ink of discs that are small 
+	// compared to their blur. Keep the amount of ink of the disc.
+	double scale = std::min(M_PI*radius*radius/sum, 1.0);
+
+	SkBitmap bitmap;
+	bitmap.allocPixels(SkImageInfo::MakeN32Premul(size, size));
+
+	for (int y = 0; y < size; y++) {
+
+		uint32_t* row = bitmap.getAddr32(0, y);
+
+		for (int x = 0; x < size; x++) {
+
+			U8CPU a = static_cast<U8CPU>(std::min(coverage[y*size + x]*scale, 1.0)*255.0 + 0.5);
+
+			// white, premultiplied
+			row[x] = SkPreMultiplyARGB(a, 255, 255, 255);
+		}
+	}
+
+	bitmap.setImmutable();
+	stamp.image = SkImage::MakeFromBitmap(bitmap);
+
+	return stamp;
+}
+
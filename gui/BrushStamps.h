@@ -0,0 +1,69 @@
+#ifndef YANTA_GUI_BRUSH_STAMPS_H__
+#define YANTA_GUI_BRUSH_STAMPS_H__
+
+#include <map>
+#include <utility>
+
+#include <SkImage.h>
+
+/**
+ * A cache of pre-blurred discs, to stamp strokes with instead of drawing 
+ * blurred circles. A stamp is an image in device pixels of a white disc with 
+ * a Gaussian blurred edge, for a quantized radius and blur. The stamps are 
+ * premultiplied, such that they can be tinted with any color and alpha by 
+ * modulating them (see SkCanvas::drawAtlas()).
+ *
+ * Not thread safe, every painter has its own stamps.
+ */
+class BrushStamps {
+
+public:
+
+	// discs with larger radii (in pixels) are not cached
+	static const unsigned int MaxRadius = 64;
+
+	struct Stamp {
+
+		sk_sp<SkImage> image;
+
+		// the position of the center of the disc in the image, in pixels
+		float center;
+	};
+
+	/**
+	 * Get the stamp for a disc with the given radius and blur sigma in 
+	 * pixels. The stamp stays valid until the next call to trim(). The radius 
+	 * has to be at most MaxRadius. Radii too small to have a stamp of their 
+	 * own get the smallest stamp, with a radius of a quarter pixel.
+	 */
+	const Stamp& get(double radius, double sigma);
+
+	/**
+	 * Forget all stamps if there are too many of them. Call this before 
+	 * drawing a stroke, not while stamps are in use.
+	 */
+	void trim();
+
+private:
+
+	// the maximal number of stamps to keep
+	static const unsigned int MaxStamps = 256;
+
+	/**
+	 * Get the quantization level of a size in pixels, and the size for a 
+	 * level.
+	 */
+	static int    toLevel(double size);
+	static double fromLevel(int level);
+
+	/**
+	 * Render a new stamp.
+	 */
+	static Stamp create(double radius, double sigma);
+
+	// stamps by level of radius and sigma
+	std::map<std::pair<int,int>, Stamp> _stamps;
+};
+
+#endif // YANTA_GUI_BRUSH_STAMPS_H__
+
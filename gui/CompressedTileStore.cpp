@@ -0,0 +1,120 @@
+#include <util/Logger.h>
+#include "CompressedTileStore.h"
+
+logger::LogChannel compressedtilestorelog("compressedtilestorelog", "[CompressedTileStore] ");
+
+CompressedTileStore::CompressedTileStore(unsigned int numSlots, unsigned int tileSize, std::size_t budget) :
+	_tileSize(tileSize*tileSize),
+	_budget(budget),
+	_used(0),
+	_slots(numSlots) {}
+
+void
+CompressedTileStore::store(unsigned int slot, const sg_gui::skia_pixel_t* pixels) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	dropLocked(slot);
+
+	TileCompressor::compress(pixels, _tileSize, _compressed);
+
+	std::size_t size = _compressed.size()*sizeof(TileCompressor::data_type::value_type);
+
+	LOG_ALL(compressedtilestorelog)
+			<< "compressed slot " << slot << " to " << size << " bytes ("
+			<< (100*size)/(_tileSize*sizeof(sg_gui::skia_pixel_t)) << "%)" << std::endl;
+
+	// not worth it, or too big to fit at all
+	if (size >= _tileSize*sizeof(sg_gui::skia_pixel_t) || size > _budget) {
+
+		if (_dropCallback)
+			_dropCallback(slot);
+
+		return;
+	}
+
+	// make room
+	while (_used + size > _budget) {
+
+		unsigned int oldest = _lru.back();
+
+		LOG_ALL(compressedtilestorelog) << "dropping slot " << oldest << std::endl;
+
+		dropLocked(oldest);
+
+		if (_dropCallback)
+			_dropCallback(oldest);
+	}
+
+	Slot& s = _slots[slot];
+
+	// keep _compressed's capacity for the next call and give the slot an
+	// exactly sized copy
+	s.data.assign(_compressed.begin(), _compressed.end());
+	s.stored = true;
+	_lru.push_front(slot);
+	s.lruPosition = _lru.begin();
+
+	_used += size;
+}
+
+bool
+CompressedTileStore::restore(unsigned int slot, sg_gui::skia_pixel_t* pixels) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	Slot& s = _slots[slot];
+
+	if (!s.stored)
+		return false;
+
+	bool success = TileCompressor::decompress(s.data, pixels, _tileSize);
+
+	dropLocked(slot);
+
+	if (!success)
+		LOG_ERROR(compressedtilestorelog) << "compressed data of slot " << slot << " is corrupt" << std::endl;
+
+	return success;
+}
+
+bool
+CompressedTileStore::contains(unsigned int slot) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	return _slots[slot].stored;
+}
+
+void
+CompressedTileStore::drop(unsigned int slot) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	dropLocked(slot);
+}
+
+void
+CompressedTileStore::dropAll() {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	while (!_lru.empty())
+		dropLocked(_lru.back());
+}
+
+void
+CompressedTileStore::dropLocked(unsigned int slot) {
+
+	Slot& s = _slots[slot];
+
+	if (!s.stored)
+		return;
+
+	_used -= s.data.size()*sizeof(TileCompressor::data_type::value_type);
+
+	_lru.erase(s.lruPosition);
+	TileCompressor::data_type().swap(s.data);
+	s.stored = false;
+}
+
@@ -0,0 +1,120 @@
+#ifndef YANTA_GUI_COMPRESSED_TILE_STORE_H__
+#define YANTA_GUI_COMPRESSED_TILE_STORE_H__
+
+#include <list>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "TileCompressor.h"
+
+/**
+ * The cold tier of the TilesCache. Holds compressed copies of tiles that lost
+ * their pixel buffer in the TilePool, such that they can be restored without
+ * rasterizing them again. Like the pool, the store is organized in slots (the
+ * physical tiles of the cache) and limited by a memory budget. If the budget
+ * is exhausted, the least recently stored slots are dropped.
+ */
+class CompressedTileStore {
+
+public:
+
+	/**
+	 * Create a new store.
+	 *
+	 * @param numSlots
+	 *              The number of slots that can store tiles.
+	 * @param tileSize
+	 *              The width and height of a tile in pixels.
+	 * @param budget
+	 *              The maximal amount of memory in bytes for compressed data.
+	 */
+	CompressedTileStore(unsigned int numSlots, unsigned int tileSize, std::size_t budget);
+
+	/**
+	 * Store a compressed copy of the given tile pixels for a slot.
+	 */
+	void store(unsigned int slot, const sg_gui::skia_pixel_t* pixels);
+
+	/**
+	 * Decompress the tile of a slot into the given pixels and remove it from
+	 * the store. Returns false, if the slot has no tile stored.
+	 */
+	bool restore(unsigned int slot, sg_gui::skia_pixel_t* pixels);
+
+	/**
+	 * Test whether a tile is stored for the given slot.
+	 */
+	bool contains(unsigned int slot);
+
+	/**
+	 * Remove the tile of a slot from the store.
+	 */
+	void drop(unsigned int slot);
+
+	/**
+	 * Remove all tiles from the store.
+	 */
+	void dropAll();
+
+	/**
+	 * Register a callback to call whenever the tile of a slot had to be dropped
+	 * to stay within the budget. The callback is invoked while the store is
+	 * locked, it must not call back into the store.
+	 */
+	void setDropCallback(boost::function<void(unsigned int)> callback) {
+
+		_dropCallback = callback;
+	}
+
+private:
+
+	typedef std::list<unsigned int> lru_type;
+
+	struct Slot {
+
+		Slot() : stored(false) {}
+
+		// is there a tile stored for this slot?
+		bool stored;
+
+		// the compressed tile
+		TileCompressor::data_type data;
+
+		// the position of this slot in the LRU list (valid only if stored)
+		lru_type::iterator lruPosition;
+	};
+
+	/**
+	 * Remove the tile of a slot. Assumes that the store is locked.
+	 */
+	void dropLocked(unsigned int slot);
+
+	// the number of pixels in a tile
+	std::size_t _tileSize;
+
+	// the memory budget in bytes
+	std::size_t _budget;
+
+	// the memory used by the compressed tiles in bytes
+	std::size_t _used;
+
+	// the slots
+	std::vector<Slot> _slots;
+
+	// slots with a stored tile, most recently stored first
+	lru_type _lru;
+
+	// buffer to compress into, reused between calls to store()
+	TileCompressor::data_type _compressed;
+
+	// callback to invoke when a slot was dropped
+	boost::function<void(unsigned int)> _dropCallback;
+
+	// protects all of the above against concurrent access
+	boost::mutex _mutex;
+};
+
+#endif // YANTA_GUI_COMPRESSED_TILE_STORE_H__
+
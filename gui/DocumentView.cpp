@@ -1,3 +1,5 @@
+#include <boost/timer/timer.hpp>
+
 #include "DocumentView.h"
 
 DocumentView::DocumentView() :
@@ -6,10 +8,38 @@ DocumentView::DocumentView() :
 				sg_gui::skia_pixel_t(255, 0, 255))),
 	_documentCleanUpPainter(
 			std::make_shared<SkiaDocumentPainter>(
-				sg_gui::skia_pixel_t(255, 255, 0))) {}
+				sg_gui::skia_pixel_t(255, 255, 0))),
+	_qualityGovernor(std::make_shared<QualityGovernor>()) {
+
+	// the open stroke is shown by the live-ink layer until it is finished
+	_documentPainter->setDrawOpenStrokes(false);
+	_documentCleanUpPainter->setDrawOpenStrokes(false);
+
+	// the governor learns how long tiles take for each quality
+	_texture.setQualityGovernor(_qualityGovernor);
+}
 
 void
 DocumentView::onSignal(sg_gui::Draw& signal) {
 
+	boost::timer::cpu_timer frameTimer;
+
+	// follow the quality the governor allows for
+	_documentPainter->setQualityLimit(_qualityGovernor->getQualityLimit());
+	_documentCleanUpPainter->setQualityLimit(_qualityGovernor->getQualityLimit());
+
+	if (_document) {
+
+		// merge finished strokes into the texture
+		util::box<DocumentPrecision,2> finished = _liveInk.update(*_document);
+
+		if (!finished.isZero())
+			_texture.markDirty(util::box<float,2>(finished.min().x(), finished.min().y(), finished.max().x(), finished.max().y()));
+	}
+
 	_texture.render(signal.roi(), *_documentPainter);
+
+	_liveInk.draw();
+
+	_qualityGovernor->addFrameTime(frameTimer.elapsed().wall*1e-9);
 }
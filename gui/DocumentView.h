@@ -5,6 +5,8 @@
 #include <document/Document.h>
 #include <gui/TexturePyramid.h>
 #include <gui/SkiaDocumentPainter.h>
+#include <gui/LiveInkLayer.h>
+#include <gui/QualityGovernor.h>
 #include <sg_gui/GuiSignals.h>
 
 class DocumentView : public sg::Agent<
@@ -32,9 +34,15 @@ private:
 	std::shared_ptr<Document> _document;
 	TexturePyramid            _texture;
 
+	// the stroke that is currently drawn, on top of the texture
+	LiveInkLayer              _liveInk;
+
 	std::shared_ptr<SkiaDocumentPainter> _documentPainter;
 	std::shared_ptr<SkiaDocumentPainter> _documentCleanUpPainter;
 
+	// limits the quality of the painters to hold the frame rate
+	std::shared_ptr<QualityGovernor> _qualityGovernor;
+
 	util::box<float,2> _currentRoi;
 };
 
@@ -0,0 +1,263 @@
+#include <cmath>
+
+#include <sg_gui/OpenGl.h>
+#include <util/Logger.h>
+#include "LiveInkLayer.h"
+#include "SkiaStrokeLinePainter.h"
+
+logger::LogChannel liveinklayerlog("liveinklayerlog", "[LiveInkLayer] ");
+
+LiveInkLayer::LiveInkLayer() :
+	_haveStroke(false),
+	_strokeBegin(0),
+	_strokeEnd(0),
+	_red(0),
+	_green(0),
+	_blue(0),
+	_alpha(255),
+	_boundingBox(0, 0, 0, 0),
+	_haveFinishedStrokes(false) {}
+
+util::box<DocumentPrecision,2>
+LiveInkLayer::update(Document& document) {
+
+	// make sure reading access to the strokes is safe
+	boost::shared_lock<boost::shared_mutex> lock(document.getStrokePoints().getMutex());
+
+	util::box<DocumentPrecision,2> finished = findFinishedStrokes(document);
+
+	// is the stroke we showed still open?
+	if (_haveStroke && (!document.hasOpenStroke() || document.getCurrentStroke().begin() != _strokeBegin)) {
+
+		LOG_DEBUG(liveinklayerlog) << "stroke starting at " << _strokeBegin << " was finished" << std::endl;
+
+		fit(finished, _boundingBox);
+		clear();
+	}
+
+	if (!document.hasOpenStroke())
+		return finished;
+
+	const Stroke& stroke = document.getCurrentStroke();
+
+	if (!_haveStroke) {
+
+		LOG_DEBUG(liveinklayerlog) << "showing new stroke starting at " << stroke.begin() << std::endl;
+
+		_haveStroke  = true;
+		_strokeBegin = stroke.begin();
+		_strokeEnd   = stroke.begin();
+		_red   = stroke.getStyle().getRed();
+		_green = stroke.getStyle().getGreen();
+		_blue  = stroke.getStyle().getBlue();
+		_alpha = stroke.getStyle().getAlpha();
+	}
+
+	addSegments(document, stroke);
+	predictTail(document, stroke);
+
+	return finished;
+}
+
+util::box<DocumentPrecision,2>
+LiveInkLayer::findFinishedStrokes(Document& document) {
+
+	util::box<DocumentPrecision,2> finished(0, 0, 0, 0);
+
+	// the strokes that exist already when we see the document for the first 
+	// time are not ours to report
+	bool report = _haveFinishedStrokes;
+	_haveFinishedStrokes = true;
+
+	if (_finishedStrokes.size() < document.numPages())
+		_finishedStrokes.resize(document.numPages(), 0);
+
+	for (unsigned int i = 0; i < document.numPages(); i++) {
+
+		const Page& page = document.getPage(i);
+
+		// only the last stroke of a page can be open
+		unsigned int numFinished = page.numStrokes();
+		if (numFinished > 0 && !page.currentStroke().finished())
+			numFinished--;
+
+		// Strokes that were finished since the last call, including the ones 
+		// that were started and finished in between and never shown by us. 
+		// Fewer strokes than before means some were erased, which is reported 
+		// by the eraser.
+		if (report)
+			for (unsigned int s = _finishedStrokes[i]; s < numFinished; s++)
+				fit(finished, page.getStroke(s).getBoundingBox()*page.getScale() + page.getShift());
+
+		_finishedStrokes[i] = numFinished;
+	}
+
+	return finished;
+}
+
+void
+LiveInkLayer::fit(util::box<DocumentPrecision,2>& box, const util::box<DocumentPrecision,2>& other) {
+
+	if (other.isZero())
+		return;
+
+	if (box.isZero()) {
+
+		box = other;
+		return;
+	}
+
+	box.fit(other.min());
+	box.fit(other.max());
+}
+
+void
+LiveInkLayer::draw() {
+
+	if (!_haveStroke || (_vertices.empty() && _tailVertices.empty()))
+		return;
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_TEXTURE_2D);
+
+	glColor4ub(_red, _green, _blue, _alpha);
+
+	// The quads overlap at the joints. Blend each pixel only once, otherwise 
+	// translucent strokes show darker beads where the quads overlap. Without 
+	// a stencil buffer, the test always passes.
+	bool translucent = (_alpha < 255);
+	if (translucent) {
+
+		glClearStencil(0);
+		glClear(GL_STENCIL_BUFFER_BIT);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_EQUAL, 0, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	if (!_vertices.empty()) {
+
+		glVertexPointer(2, GL_FLOAT, 0, &_vertices[0]);
+		glDrawArrays(GL_QUADS, 0, _vertices.size()/2);
+	}
+
+	if (!_tailVertices.empty()) {
+
+		glVertexPointer(2, GL_FLOAT, 0, &_tailVertices[0]);
+		glDrawArrays(GL_QUADS, 0, _tailVertices.size()/2);
+	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	if (translucent)
+		glDisable(GL_STENCIL_TEST);
+
+	glDisable(GL_BLEND);
+}
+
+void
+LiveInkLayer::clear() {
+
+	_haveStroke = false;
+	_vertices.clear();
+	_tailVertices.clear();
+	_boundingBox = util::box<DocumentPrecision,2>(0, 0, 0, 0);
+}
+
+void
+LiveInkLayer::addSegments(Document& document, const Stroke& stroke) {
+
+	const Page&         page   = document.getCurrentPage();
+	const StrokePoints& points = document.getStrokePoints();
+
+	unsigned long end = stroke.end();
+
+	// the first new segment starts at the last point we saw
+	unsigned long begin = std::max(_strokeEnd, stroke.begin() + 1) - 1;
+
+	unsigned long numVertices = _vertices.size();
+
+	for (unsigned long i = begin; i + 1 < end; i++)
+		addQuad(_vertices, page, stroke, points[i], points[i + 1]);
+
+	// update the bounding box with the new corners
+	for (unsigned long i = numVertices; i < _vertices.size(); i += 2) {
+
+		util::point<DocumentPrecision,2> corner(_vertices[i], _vertices[i + 1]);
+
+		if (i == 0)
+			_boundingBox = util::box<DocumentPrecision,2>(corner.x(), corner.y(), corner.x(), corner.y());
+		else
+			_boundingBox.fit(corner);
+	}
+
+	_strokeEnd = std::max(_strokeEnd, end);
+}
+
+void
+LiveInkLayer::predictTail(Document& document, const Stroke& stroke) {
+
+	// the previous prediction is obsolete with every new sample
+	_tailVertices.clear();
+
+	if (stroke.size() == 0)
+		return;
+
+	const StrokePoints& points = document.getStrokePoints();
+
+	_predictor.predictTail(points, stroke.begin(), stroke.end(), _tail);
+
+	const StrokePoint* from = &points[stroke.end() - 1];
+
+	for (unsigned int i = 0; i < _tail.size(); i++) {
+
+		addQuad(_tailVertices, document.getCurrentPage(), stroke, *from, _tail[i]);
+		from = &_tail[i];
+	}
+}
+
+void
+LiveInkLayer::addQuad(
+		std::vector<float>& vertices,
+		const Page&         page,
+		const Stroke&       stroke,
+		const StrokePoint&  from,
+		const StrokePoint&  to) {
+
+	// the end points of the segment in document units
+	util::point<DocumentPrecision,2> p =
+			(from.position*stroke.getScale() + stroke.getShift())*page.getScale() + page.getShift();
+	util::point<DocumentPrecision,2> q =
+			(to.position*stroke.getScale() + stroke.getShift())*page.getScale() + page.getShift();
+
+	util::point<DocumentPrecision,2> direction = q - p;
+	double length = std::sqrt(direction.x()*direction.x() + direction.y()*direction.y());
+
+	if (length == 0)
+		return;
+
+	// same width as the line painter, scaled to document units
+	double width = SkiaStrokeLinePainter::widthPressureCurve(from.pressure)*stroke.getStyle().width()*page.getScale().x();
+
+	// half the width, perpendicular to the segment
+	util::point<DocumentPrecision,2> normal(-direction.y(), direction.x());
+	normal *= 0.5*width/length;
+
+	// extend the segment a bit in both directions to close the gaps between 
+	// consecutive segments
+	util::point<DocumentPrecision,2> extension = direction*(0.5*width/length);
+	p -= extension;
+	q += extension;
+
+	util::point<DocumentPrecision,2> corners[4] = { p + normal, q + normal, q - normal, p - normal };
+
+	for (int c = 0; c < 4; c++) {
+
+		vertices.push_back(corners[c].x());
+		vertices.push_back(corners[c].y());
+	}
+}
+
@@ -0,0 +1,118 @@
+#ifndef YANTA_GUI_LIVE_INK_LAYER_H__
+#define YANTA_GUI_LIVE_INK_LAYER_H__
+
+#include <vector>
+
+#include <util/box.hpp>
+#include <document/Document.h>
+#include <document/InkPredictor.h>
+
+/**
+ * A front layer that shows the stroke that is currently drawn with the pen.
+ * The stroke is drawn directly with OpenGl every frame, without going through
+ * the rasterization of the tiles. Only the newest points of the stroke are
+ * processed in each frame, previous segments are kept as vertices.
+ *
+ * If enabled, the layer also shows a predicted tail in front of the last
+ * sample, which is replaced with every update.
+ *
+ * Once the stroke is finished, update() reports its area, such that the
+ * caller can merge it into the tiles.
+ */
+class LiveInkLayer {
+
+public:
+
+	LiveInkLayer();
+
+	/**
+	 * Bring the layer up-to-date with the open stroke of the given document.
+	 *
+	 * @return The bounding box of all strokes that got finished since the 
+	 *         last call (including the one shown so far, and strokes that 
+	 *         were started and finished in between). A zero box otherwise.
+	 */
+	util::box<DocumentPrecision,2> update(Document& document);
+
+	/**
+	 * Draw the open stroke as of the last call to update(). Uses (and clears) 
+	 * the stencil buffer to cover each pixel only once.
+	 */
+	void draw();
+
+private:
+
+	/**
+	 * Forget about the current stroke.
+	 */
+	void clear();
+
+	/**
+	 * Get the bounding box of the strokes of the document that were finished 
+	 * since the last call.
+	 */
+	util::box<DocumentPrecision,2> findFinishedStrokes(Document& document);
+
+	/**
+	 * Grow box to contain other. Zero boxes are considered empty.
+	 */
+	void fit(util::box<DocumentPrecision,2>& box, const util::box<DocumentPrecision,2>& other);
+
+	/**
+	 * Add the quads for the segments of the stroke that are new since the last
+	 * call.
+	 */
+	void addSegments(Document& document, const Stroke& stroke);
+
+	/**
+	 * Replace the quads of the predicted tail.
+	 */
+	void predictTail(Document& document, const Stroke& stroke);
+
+	/**
+	 * Add a quad for the line between the given stroke points to vertices.
+	 */
+	void addQuad(
+			std::vector<float>& vertices,
+			const Page&         page,
+			const Stroke&       stroke,
+			const StrokePoint&  from,
+			const StrokePoint&  to);
+
+	// are we showing a stroke?
+	bool _haveStroke;
+
+	// the first stroke point of the stroke we are showing, to identify it
+	unsigned long _strokeBegin;
+
+	// the stroke point until which we created quads already
+	unsigned long _strokeEnd;
+
+	// the color of the stroke
+	unsigned char _red, _green, _blue, _alpha;
+
+	// the corners of the quads for the segments of the stroke in document
+	// units
+	std::vector<float> _vertices;
+
+	// the quads for the predicted tail of the stroke
+	std::vector<float> _tailVertices;
+
+	// extrapolates the stroke beyond the last sample
+	InkPredictor _predictor;
+
+	// buffer for the predicted points
+	std::vector<StrokePoint> _tail;
+
+	// the area covered by the stroke in document units
+	util::box<DocumentPrecision,2> _boundingBox;
+
+	// the number of finished strokes per page, as of the last update
+	std::vector<unsigned int> _finishedStrokes;
+
+	// did we count the finished strokes before?
+	bool _haveFinishedStrokes;
+};
+
+#endif // YANTA_GUI_LIVE_INK_LAYER_H__
+
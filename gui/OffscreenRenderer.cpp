@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cmath>
+
+#include <SkBitmap.h>
+
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include "OffscreenRenderer.h"
+#include "SkiaDocumentPainter.h"
+
+logger::LogChannel offscreenrendererlog("offscreenrendererlog", "[OffscreenRenderer] ");
+
+util::ProgramOption optionRenderThreads(
+		util::_long_name        = "renderThreads",
+		util::_description_text = "The number of threads to use for offscreen rendering. 0 uses one thread per core.",
+		util::_default_value    = 0);
+
+OffscreenRenderer::OffscreenRenderer(std::shared_ptr<Document> document, unsigned int numThreads) :
+	_document(document),
+	_numThreads(numThreads) {
+
+	if (_numThreads == 0)
+		_numThreads = optionRenderThreads.as<unsigned int>();
+
+	if (_numThreads == 0)
+		_numThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+
+	LOG_DEBUG(offscreenrendererlog) << "using " << _numThreads << " threads" << std::endl;
+}
+
+util::box<int,2>
+OffscreenRenderer::getPixelRegion(const util::box<DocumentPrecision,2>& region, double pixelsPerUnit) {
+
+	return util::box<int,2>(
+			static_cast<int>(std::floor(region.min().x()*pixelsPerUnit)),
+			static_cast<int>(std::floor(region.min().y()*pixelsPerUnit)),
+			static_cast<int>(std::ceil(region.max().x()*pixelsPerUnit)),
+			static_cast<int>(std::ceil(region.max().y()*pixelsPerUnit)));
+}
+
+void
+OffscreenRenderer::render(
+		const util::box<int,2>& pixelRegion,
+		double                  pixelsPerUnit,
+		sg_gui::skia_pixel_t*   pixels,
+		std::size_t             rowBytes) {
+
+	if (pixelRegion.area() <= 0)
+		return;
+
+	Job job;
+	job.pixelRegion   = pixelRegion;
+	job.pixelsPerUnit = pixelsPerUnit;
+	job.pixels        = pixels;
+	job.rowBytes      = rowBytes;
+	job.tilesX        = (pixelRegion.width()  + TileSize - 1)/TileSize;
+	job.numTiles      = job.tilesX*((pixelRegion.height() + TileSize - 1)/TileSize);
+	job.nextTile      = 0;
+
+	LOG_DEBUG(offscreenrendererlog) << "rendering " << pixelRegion << " in " << job.numTiles << " tiles" << std::endl;
+
+	unsigned int numThreads = std::min(_numThreads, job.numTiles);
+
+	// the calling thread is one of the render threads
+	boost::thread_group threads;
+	for (unsigned int i = 1; i < numThreads; i++)
+		threads.create_thread(boost::bind(&OffscreenRenderer::renderTiles, this, boost::ref(job)));
+
+	renderTiles(job);
+
+	threads.join_all();
+}
+
+void
+OffscreenRenderer::renderTiles(Job& job) {
+
+	// each thread needs its own painter, they remember what they draw
+	SkiaDocumentPainter painter;
+	painter.setDocument(_document);
+	painter.setDeviceTransformation(util::point<double,2>(job.pixelsPerUnit, job.pixelsPerUnit), util::point<int,2>(0, 0));
+
+	while (true) {
+
+		unsigned int tile;
+
+		{
+			boost::lock_guard<boost::mutex> lock(job.mutex);
+
+			if (job.nextTile == job.numTiles)
+				return;
+
+			tile = job.nextTile++;
+		}
+
+		// the tile in pixels, relative to the pixel region
+		util::point<int,2> offset((tile%job.tilesX)*TileSize, (tile/job.tilesX)*TileSize);
+		util::point<int,2> size(
+				std::min(static_cast<int>(TileSize), job.pixelRegion.width()  - offset.x()),
+				std::min(static_cast<int>(TileSize), job.pixelRegion.height() - offset.y()));
+
+		util::box<int,2> tileRegion(
+				job.pixelRegion.min().x() + offset.x(),
+				job.pixelRegion.min().y() + offset.y(),
+				job.pixelRegion.min().x() + offset.x() + size.x(),
+				job.pixelRegion.min().y() + offset.y() + size.y());
+
+		LOG_ALL(offscreenrendererlog) << "rendering tile " << tileRegion << std::endl;
+
+		// wrap the part of the output that belongs to this tile in a skia 
+		// bitmap
+		char* tilePixels =
+				reinterpret_cast<char*>(job.pixels) +
+				offset.y()*job.rowBytes +
+				offset.x()*sizeof(sg_gui::skia_pixel_t);
+
+		SkBitmap bitmap;
+		bitmap.setInfo(SkImageInfo::MakeN32Premul(size.x(), size.y()), job.rowBytes);
+		bitmap.setPixels(tilePixels);
+
+		SkCanvas canvas(bitmap);
+
+		// translate the upper left of the tile to (0,0)
+		canvas.translate(-tileRegion.min().x(), -tileRegion.min().y());
+
+		painter.draw(
+				canvas,
+				util::box<DocumentPrecision,2>(
+						tileRegion.min().x(),
+						tileRegion.min().y(),
+						tileRegion.max().x(),
+						tileRegion.max().y()));
+	}
+}
+
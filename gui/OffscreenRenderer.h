@@ -0,0 +1,84 @@
+#ifndef YANTA_GUI_OFFSCREEN_RENDERER_H__
+#define YANTA_GUI_OFFSCREEN_RENDERER_H__
+
+#include <memory>
+
+#include <boost/thread.hpp>
+
+#include <sg_gui/Skia.h>
+#include <util/box.hpp>
+#include <document/Document.h>
+
+/**
+ * Renders parts of a document into memory, without a window or OpenGl 
+ * context. The output is split into tiles that are rasterized in parallel, 
+ * each thread with its own SkiaDocumentPainter.
+ */
+class OffscreenRenderer {
+
+public:
+
+	// the size of the tiles the output is split into
+	static const unsigned int TileSize = 512;
+
+	/**
+	 * Create a renderer for the given document that uses numThreads threads. 
+	 * If numThreads is zero, the number of threads is given by the program 
+	 * option 'renderThreads', or the number of cores if that is zero as well.
+	 */
+	OffscreenRenderer(std::shared_ptr<Document> document, unsigned int numThreads = 0);
+
+	/**
+	 * Get the region in pixels that covers the given region in document units 
+	 * at the given resolution.
+	 */
+	static util::box<int,2> getPixelRegion(const util::box<DocumentPrecision,2>& region, double pixelsPerUnit);
+
+	/**
+	 * Render the pixels in pixelRegion of the document, drawn with 
+	 * pixelsPerUnit pixels per document unit, into the given memory. The 
+	 * memory has to hold pixelRegion.height() rows of rowBytes bytes each.
+	 */
+	void render(
+			const util::box<int,2>& pixelRegion,
+			double                  pixelsPerUnit,
+			sg_gui::skia_pixel_t*   pixels,
+			std::size_t             rowBytes);
+
+	/**
+	 * Get the number of threads used for rendering.
+	 */
+	unsigned int getNumThreads() const { return _numThreads; }
+
+private:
+
+	// the tiles of one call to render()
+	struct Job {
+
+		util::box<int,2>      pixelRegion;
+		double                pixelsPerUnit;
+		sg_gui::skia_pixel_t* pixels;
+		std::size_t           rowBytes;
+
+		// the number of tiles in x and the total number of tiles
+		unsigned int tilesX;
+		unsigned int numTiles;
+
+		// the next tile to render and its mutex
+		unsigned int nextTile;
+		boost::mutex mutex;
+	};
+
+	/**
+	 * Entry point of the render threads. Renders tiles of the job until there 
+	 * are none left.
+	 */
+	void renderTiles(Job& job);
+
+	std::shared_ptr<Document> _document;
+
+	unsigned int _numThreads;
+};
+
+#endif // YANTA_GUI_OFFSCREEN_RENDERER_H__
+
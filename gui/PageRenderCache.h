@@ -0,0 +1,97 @@
+#ifndef YANTA_GUI_PAGE_RENDER_CACHE_H__
+#define YANTA_GUI_PAGE_RENDER_CACHE_H__
+
+#include <SkPicture.h>
+
+#include <document/Page.h>
+#include "Quality.h"
+
+/**
+ * The recorded drawing commands for the finished strokes of a page, attached 
+ * to the page (see Page::setRenderCache()) to be replayed by later draws. A 
+ * cache remembers the version of the page and the scale it was recorded for, 
+ * and holds one picture for each quality. Changing the finished strokes of 
+ * the page invalidates it.
+ *
+ * Once attached to a page, a cache is shared between threads and must not be 
+ * changed anymore. To add to it, attach a modified copy (see 
+ * Page::replaceRenderCache()). A picture is recorded only once for each 
+ * quality: the painter that wants to record it first attaches a copy that 
+ * marks the picture as being recorded, other painters don't wait for it.
+ */
+class PageRenderCache {
+
+public:
+
+	/**
+	 * Create an empty cache for the current version of the given page.
+	 *
+	 * @param page  The page to record pictures for.
+	 * @param scale The number of pixels per page unit the strokes are drawn 
+	 *              for. The pictures themselves are in pixel units.
+	 */
+	PageRenderCache(const Page& page, double scale) :
+		_version(page.getVersion()),
+		_scale(scale) {
+
+		for (int i = 0; i < NumQualities; i++) {
+
+			_havePicture[i] = false;
+			_recording[i]   = false;
+		}
+	}
+
+	/**
+	 * Check whether this cache can be used to draw the given page with the 
+	 * given scale.
+	 */
+	bool isValidFor(const Page& page, double scale) const {
+
+		return page.getVersion() == _version && scale == _scale;
+	}
+
+	/**
+	 * Check whether a picture was recorded for the given quality.
+	 */
+	bool hasPicture(Quality quality) const { return _havePicture[quality]; }
+
+	/**
+	 * Check whether a picture for the given quality is being recorded.
+	 */
+	bool isRecording(Quality quality) const { return _recording[quality]; }
+
+	/**
+	 * Mark the picture for the given quality as being recorded.
+	 */
+	void setRecording(Quality quality) { _recording[quality] = true; }
+
+	/**
+	 * Get the picture of the finished strokes for the given quality, in pixel 
+	 * units. Can be empty, if there are no finished strokes.
+	 */
+	const sk_sp<SkPicture>& getPicture(Quality quality) const { return _pictures[quality]; }
+
+	/**
+	 * Set the picture of the finished strokes for the given quality.
+	 */
+	void setPicture(Quality quality, sk_sp<SkPicture> picture) {
+
+		_pictures[quality]    = picture;
+		_havePicture[quality] = true;
+		_recording[quality]   = false;
+	}
+
+private:
+
+	// the number of qualities to record pictures for (all but Auto)
+	static const int NumQualities = Auto;
+
+	unsigned long    _version;
+	double           _scale;
+	sk_sp<SkPicture> _pictures[NumQualities];
+	bool             _havePicture[NumQualities];
+	bool             _recording[NumQualities];
+};
+
+#endif // YANTA_GUI_PAGE_RENDER_CACHE_H__
+
@@ -0,0 +1,76 @@
+// we need the prototypes of the buffer object functions (OpenGl 2.1)
+#define GL_GLEXT_PROTOTYPES
+
+#include <sg_gui/OpenGl.h>
+#include <GL/glext.h>
+#include <util/Logger.h>
+#include "PixelBufferRing.h"
+
+logger::LogChannel pixelbufferringlog("pixelbufferringlog", "[PixelBufferRing] ");
+
+PixelBufferRing::PixelBufferRing(unsigned int numBuffers, std::size_t size) :
+	_buffers(numBuffers),
+	_size(size),
+	_next(0),
+	_current(0) {
+
+	LOG_DEBUG(pixelbufferringlog) << "creating " << numBuffers << " pixel buffers of " << size << " bytes" << std::endl;
+
+	glGenBuffers(numBuffers, &_buffers[0]);
+
+	for (unsigned int i = 0; i < numBuffers; i++) {
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, _size, 0, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelBufferRing::~PixelBufferRing() {
+
+	glDeleteBuffers(_buffers.size(), &_buffers[0]);
+}
+
+void*
+PixelBufferRing::map() {
+
+	_current = _next;
+	_next    = (_next + 1)%_buffers.size();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[_current]);
+
+	// Orphan the previous storage of the buffer. If the GPU is still reading 
+	// from it, the driver hands us fresh memory instead of blocking.
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, _size, 0, GL_STREAM_DRAW);
+
+	void* memory = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!memory)
+		LOG_ERROR(pixelbufferringlog) << "could not map pixel buffer " << _current << std::endl;
+
+	return memory;
+}
+
+bool
+PixelBufferRing::unmapAndBind() {
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[_current]);
+
+	if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+
+		LOG_ERROR(pixelbufferringlog) << "content of pixel buffer " << _current << " got lost" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void
+PixelBufferRing::unbind() {
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
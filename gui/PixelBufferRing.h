@@ -0,0 +1,68 @@
+#ifndef YANTA_GUI_PIXEL_BUFFER_RING_H__
+#define YANTA_GUI_PIXEL_BUFFER_RING_H__
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * A ring of OpenGl pixel buffer objects to stream pixel data into textures. 
+ * The memory of a buffer is mapped by the render thread, can then be filled 
+ * by any thread, and is finally handed to the GPU to source texture uploads 
+ * from. Cycling through several buffers avoids waiting for the GPU to finish 
+ * reading the previous upload. All methods, except for writing to the mapped 
+ * memory, have to be called with a valid OpenGl context.
+ */
+class PixelBufferRing {
+
+public:
+
+	/**
+	 * Create a ring of numBuffers buffers with size bytes each.
+	 */
+	PixelBufferRing(unsigned int numBuffers, std::size_t size);
+
+	~PixelBufferRing();
+
+	/**
+	 * Map the next buffer of the ring for writing. Returns 0 if the buffer 
+	 * could not be mapped.
+	 */
+	void* map();
+
+	/**
+	 * Unmap the currently mapped buffer and bind it as the source for pixel 
+	 * uploads. While bound, the data argument of glTexSubImage2D() is 
+	 * interpreted as an offset into the buffer. Returns false, if the content 
+	 * of the buffer got lost while it was mapped (it is still bound in this 
+	 * case, and has to be unbound).
+	 */
+	bool unmapAndBind();
+
+	/**
+	 * Unbind the current buffer, such that pixel uploads source from client 
+	 * memory again.
+	 */
+	void unbind();
+
+	/**
+	 * Get the size of the buffers in bytes.
+	 */
+	std::size_t getSize() const { return _size; }
+
+private:
+
+	// the OpenGl names of the buffers
+	std::vector<unsigned int> _buffers;
+
+	// the size of each buffer in bytes
+	std::size_t _size;
+
+	// the buffer to map next
+	unsigned int _next;
+
+	// the currently mapped buffer
+	unsigned int _current;
+};
+
+#endif // YANTA_GUI_PIXEL_BUFFER_RING_H__
+
@@ -0,0 +1,77 @@
+// we need the prototypes of the buffer object functions (OpenGl 2.1)
+#define GL_GLEXT_PROTOTYPES
+
+#include <sg_gui/OpenGl.h>
+#include <GL/glext.h>
+#include <util/Logger.h>
+#include "QuadBatch.h"
+
+logger::LogChannel quadbatchlog("quadbatchlog", "[QuadBatch] ");
+
+QuadBatch::QuadBatch() :
+	_buffer(0),
+	_changed(false) {}
+
+QuadBatch::~QuadBatch() {
+
+	if (_buffer)
+		glDeleteBuffers(1, &_buffer);
+}
+
+void
+QuadBatch::clear() {
+
+	_vertices.clear();
+	_changed = true;
+}
+
+void
+QuadBatch::add(const util::box<float,2>& position, const util::box<float,2>& texCoords) {
+
+	const float quad[4*FloatsPerVertex] = {
+		position.min().x(), position.min().y(), texCoords.min().x(), texCoords.min().y(),
+		position.max().x(), position.min().y(), texCoords.max().x(), texCoords.min().y(),
+		position.max().x(), position.max().y(), texCoords.max().x(), texCoords.max().y(),
+		position.min().x(), position.max().y(), texCoords.min().x(), texCoords.max().y()
+	};
+
+	_vertices.insert(_vertices.end(), quad, quad + 4*FloatsPerVertex);
+	_changed = true;
+}
+
+void
+QuadBatch::draw() {
+
+	if (_vertices.empty())
+		return;
+
+	if (!_buffer)
+		glGenBuffers(1, &_buffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+
+	if (_changed) {
+
+		LOG_ALL(quadbatchlog) << "uploading " << size() << " quads" << std::endl;
+
+		glBufferData(GL_ARRAY_BUFFER, _vertices.size()*sizeof(float), &_vertices[0], GL_STATIC_DRAW);
+		_changed = false;
+	}
+
+	const GLsizei stride = FloatsPerVertex*sizeof(float);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	// with a bound vertex buffer, the pointers are offsets into the buffer
+	glVertexPointer(2, GL_FLOAT, stride, reinterpret_cast<const GLvoid*>(0));
+	glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<const GLvoid*>(2*sizeof(float)));
+
+	glDrawArrays(GL_QUADS, 0, 4*size());
+
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
@@ -0,0 +1,59 @@
+#ifndef YANTA_GUI_QUAD_BATCH_H__
+#define YANTA_GUI_QUAD_BATCH_H__
+
+#include <vector>
+
+#include <util/box.hpp>
+
+/**
+ * A set of textured quads that are kept in an OpenGl vertex buffer and drawn 
+ * with a single call. The quads are meant to be rebuilt only when they 
+ * change, the vertex buffer is updated lazily on the next draw(). All methods 
+ * except for clear() and add() have to be called with a valid OpenGl context.
+ */
+class QuadBatch {
+
+public:
+
+	QuadBatch();
+
+	~QuadBatch();
+
+	/**
+	 * Remove all quads.
+	 */
+	void clear();
+
+	/**
+	 * Add a quad covering position, showing the part texCoords of the 
+	 * currently bound texture.
+	 */
+	void add(const util::box<float,2>& position, const util::box<float,2>& texCoords);
+
+	/**
+	 * Draw all quads with the currently bound texture.
+	 */
+	void draw();
+
+	/**
+	 * The number of quads in the batch.
+	 */
+	unsigned int size() const { return _vertices.size()/(4*FloatsPerVertex); }
+
+private:
+
+	// x, y, s, t
+	static const unsigned int FloatsPerVertex = 4;
+
+	// the interleaved vertices of the quads
+	std::vector<float> _vertices;
+
+	// the OpenGl name of the vertex buffer, 0 if not created yet
+	unsigned int _buffer;
+
+	// does the vertex buffer need to be updated?
+	bool _changed;
+};
+
+#endif // YANTA_GUI_QUAD_BATCH_H__
+
@@ -0,0 +1,183 @@
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include "QualityGovernor.h"
+
+logger::LogChannel qualitygovernorlog("qualitygovernorlog", "[QualityGovernor] ");
+
+util::ProgramOption optionTargetFrameRate(
+		util::_long_name        = "targetFrameRate",
+		util::_description_text = "The number of frames per second to hold by lowering the quality of the rendering.",
+		util::_default_value    = 60);
+
+namespace {
+
+// weight of a new sample in the running averages
+const double averageWeight = 0.1;
+
+// frames are over the budget if they take longer than this fraction of it
+const double overBudget = 1.2;
+
+// frames are well below the budget if they take less than this fraction of it
+const double belowBudget = 0.6;
+
+// the number of consecutive frames over the budget to lower the quality
+const unsigned int framesToLower = 10;
+
+// the number of consecutive frames well below the budget to raise the 
+// quality
+const unsigned int framesToRaise = 120;
+
+// the number of frames to wait after a change for the averages to settle
+const unsigned int cooldownFrames = 30;
+
+// the fraction of the frame budget a single tile of the next quality may 
+// take, to consider raising the quality
+const double tileBudget = 0.25;
+
+// the number of tile times to wait for before deciding about a quality on 
+// probation
+const unsigned int probationSamples = 5;
+
+} // anonymous namespace
+
+QualityGovernor::QualityGovernor() :
+	_frameBudget(1.0/optionTargetFrameRate.as<double>()),
+	_frameTime(0),
+	_framesOverBudget(0),
+	_framesBelowBudget(0),
+	_cooldown(0),
+	_qualityLimit(Best),
+	_onProbation(false) {
+
+	for (int i = 0; i < Auto; i++) {
+
+		_tileTimes[i]   = 0;
+		_tileSamples[i] = 0;
+	}
+}
+
+void
+QualityGovernor::addFrameTime(double seconds) {
+
+	_frameTime = (_frameTime == 0 ? seconds : (1.0 - averageWeight)*_frameTime + averageWeight*seconds);
+
+	// a quality that was raised to without knowing its tile times is given up 
+	// as soon as they turn out to be too slow
+	if (_onProbation) {
+
+		double tileTime;
+
+		if (getTileTime(_qualityLimit, tileTime, probationSamples)) {
+
+			_onProbation = false;
+
+			if (isTooSlow(_qualityLimit)) {
+
+				_qualityLimit = static_cast<Quality>(_qualityLimit - 1);
+
+				LOG_DEBUG(qualitygovernorlog)
+						<< "tiles take " << tileTime << "s, lowering quality back to "
+						<< _qualityLimit << std::endl;
+
+				_framesOverBudget  = 0;
+				_framesBelowBudget = 0;
+				_cooldown          = cooldownFrames;
+				return;
+			}
+		}
+	}
+
+	if (_cooldown > 0) {
+
+		_cooldown--;
+		return;
+	}
+
+	if (_frameTime > overBudget*_frameBudget) {
+
+		_framesOverBudget++;
+		_framesBelowBudget = 0;
+
+	} else if (_frameTime < belowBudget*_frameBudget) {
+
+		_framesBelowBudget++;
+		_framesOverBudget = 0;
+
+	} else {
+
+		_framesOverBudget  = 0;
+		_framesBelowBudget = 0;
+	}
+
+	if (_framesOverBudget >= framesToLower && _qualityLimit > Worst) {
+
+		_qualityLimit = static_cast<Quality>(_qualityLimit - 1);
+
+		LOG_DEBUG(qualitygovernorlog)
+				<< "average frame time " << _frameTime << "s is over budget, lowering quality to "
+				<< _qualityLimit << std::endl;
+
+		_framesOverBudget = 0;
+		_cooldown         = cooldownFrames;
+	}
+
+	if (_framesBelowBudget >= framesToRaise && _qualityLimit < Best) {
+
+		Quality next = static_cast<Quality>(_qualityLimit + 1);
+
+		// don't raise to a quality that is known to be too slow, and try 
+		// qualities that were not measured yet
+		if (!isTooSlow(next)) {
+
+			double tileTime;
+
+			_qualityLimit = next;
+			_onProbation  = !getTileTime(next, tileTime);
+
+			LOG_DEBUG(qualitygovernorlog)
+					<< "average frame time " << _frameTime << "s is well below budget, raising quality to "
+					<< _qualityLimit << (_onProbation ? " on probation" : "") << std::endl;
+
+			_cooldown = cooldownFrames;
+		}
+
+		_framesBelowBudget = 0;
+	}
+}
+
+void
+QualityGovernor::addTileTime(Quality quality, double seconds) {
+
+	if (quality >= Auto)
+		return;
+
+	boost::lock_guard<boost::mutex> lock(_tileTimesMutex);
+
+	double& average = _tileTimes[quality];
+	average = (_tileSamples[quality] == 0 ? seconds : (1.0 - averageWeight)*average + averageWeight*seconds);
+	_tileSamples[quality]++;
+}
+
+bool
+QualityGovernor::getTileTime(Quality quality, double& seconds, unsigned int minSamples) {
+
+	boost::lock_guard<boost::mutex> lock(_tileTimesMutex);
+
+	if (_tileSamples[quality] < minSamples)
+		return false;
+
+	seconds = _tileTimes[quality];
+	return true;
+}
+
+bool
+QualityGovernor::isTooSlow(Quality quality) {
+
+	double tileTime;
+
+	if (!getTileTime(quality, tileTime))
+		return false;
+
+	return tileTime > tileBudget*_frameBudget;
+}
+
@@ -0,0 +1,101 @@
+#ifndef YANTA_GUI_QUALITY_GOVERNOR_H__
+#define YANTA_GUI_QUALITY_GOVERNOR_H__
+
+#include <boost/thread.hpp>
+#include "Quality.h"
+
+/**
+ * Limits the quality of rasterizers to hold a target frame rate. The governor 
+ * is fed with the time spent in each frame and the time it took to rasterize 
+ * tiles, and lowers or raises the quality limit accordingly.
+ *
+ * To not oscillate between two qualities, the limit is lowered only after 
+ * several frames over the budget, and raised only after many frames well 
+ * below the budget, and only if tiles of the next quality are expected to be 
+ * affordable. After each change, the governor waits for the frame times to 
+ * settle before changing the limit again.
+ *
+ * The cost of a quality that was never measured is unknown. The governor 
+ * raises the limit to such a quality on probation: as soon as the first tile 
+ * times for it are reported and turn out to be too slow, the limit is lowered 
+ * again without waiting for the frame times.
+ *
+ * Frame times are reported by the render thread, tile times can be reported 
+ * by any thread.
+ */
+class QualityGovernor {
+
+public:
+
+	/**
+	 * Create a governor for the target frame rate given by the program option 
+	 * 'targetFrameRate'.
+	 */
+	QualityGovernor();
+
+	/**
+	 * Report the time (in seconds) spent on the last frame. This might change 
+	 * the quality limit.
+	 */
+	void addFrameTime(double seconds);
+
+	/**
+	 * Report the time (in seconds) it took to rasterize a tile with the given 
+	 * quality.
+	 */
+	void addTileTime(Quality quality, double seconds);
+
+	/**
+	 * Get the highest quality rasterizers should use at the moment.
+	 */
+	Quality getQualityLimit() const { return _qualityLimit; }
+
+	/**
+	 * Get the target time per frame in seconds.
+	 */
+	double getFrameBudget() const { return _frameBudget; }
+
+private:
+
+	/**
+	 * Get the average time to rasterize a tile with the given quality. Returns 
+	 * false if it was measured less than minSamples times.
+	 */
+	bool getTileTime(Quality quality, double& seconds, unsigned int minSamples = 1);
+
+	/**
+	 * Check whether tiles of the given quality are known to be too slow for 
+	 * the frame budget.
+	 */
+	bool isTooSlow(Quality quality);
+
+	// the target time per frame in seconds
+	double _frameBudget;
+
+	// running average of the frame times
+	double _frameTime;
+
+	// running averages of the tile times for each quality (except Auto), and 
+	// the number of times they are based on
+	double       _tileTimes[Auto];
+	unsigned int _tileSamples[Auto];
+
+	// protect _tileTimes
+	boost::mutex _tileTimesMutex;
+
+	// the number of consecutive frames over and well below the budget
+	unsigned int _framesOverBudget;
+	unsigned int _framesBelowBudget;
+
+	// the number of frames to wait before the next change
+	unsigned int _cooldown;
+
+	// the current limit
+	Quality _qualityLimit;
+
+	// was the limit raised to a quality with unknown tile times?
+	bool _onProbation;
+};
+
+#endif // YANTA_GUI_QUALITY_GOVERNOR_H__
+
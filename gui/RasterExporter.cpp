@@ -0,0 +1,294 @@
+#include <csetjmp>
+#include <cstdio>
+
+#include <png.h>
+
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include "OffscreenRenderer.h"
+#include "RasterExporter.h"
+
+logger::LogChannel rasterexporterlog("rasterexporterlog", "[RasterExporter] ");
+
+util::ProgramOption optionExportBandHeight(
+		util::_long_name        = "exportBandHeight",
+		util::_description_text = "The height (in pixels) of the bands to render raster exports in.",
+		util::_default_value    = 256);
+
+// defined in OffscreenRenderer.cpp
+extern util::ProgramOption optionRenderThreads;
+
+namespace {
+
+/**
+ * Writes a PNG image row by row.
+ */
+class PngWriter {
+
+public:
+
+	PngWriter() :
+		_file(0),
+		_png(0),
+		_info(0) {}
+
+	~PngWriter() {
+
+		if (_png)
+			png_destroy_write_struct(&_png, &_info);
+
+		if (_file)
+			std::fclose(_file);
+	}
+
+	/**
+	 * Open the file and write the header of an RGB image with the given size.
+	 */
+	bool open(const std::string& filename, unsigned int width, unsigned int height) {
+
+		_file = std::fopen(filename.c_str(), "wb");
+
+		if (!_file) {
+
+			LOG_ERROR(rasterexporterlog) << "could not open " << filename << std::endl;
+			return false;
+		}
+
+		_png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+
+		if (!_png)
+			return false;
+
+		_info = png_create_info_struct(_png);
+
+		if (!_info)
+			return false;
+
+		if (setjmp(png_jmpbuf(_png)))
+			return false;
+
+		png_init_io(_png, _file);
+
+		png_set_IHDR(
+				_png, _info,
+				width, height,
+				8,
+				PNG_COLOR_TYPE_RGB,
+				PNG_INTERLACE_NONE,
+				PNG_COMPRESSION_TYPE_DEFAULT,
+				PNG_FILTER_TYPE_DEFAULT);
+
+		png_write_info(_png, _info);
+
+		// Our rows are skia's N32 pixels (BGRA on little-endian machines). The 
+		// exported pages are opaque, so we let libpng drop the alpha channel.
+		png_set_bgr(_png);
+		png_set_filler(_png, 0, PNG_FILLER_AFTER);
+
+		return true;
+	}
+
+	/**
+	 * Append rows to the image.
+	 */
+	bool writeRows(const sg_gui::skia_pixel_t* pixels, unsigned int width, unsigned int numRows) {
+
+		if (setjmp(png_jmpbuf(_png)))
+			return false;
+
+		for (unsigned int i = 0; i < numRows; i++)
+			png_write_row(_png, reinterpret_cast<png_const_bytep>(pixels + i*width));
+
+		return true;
+	}
+
+	/**
+	 * Write the end of the image, after all rows have been written.
+	 */
+	bool finish() {
+
+		if (setjmp(png_jmpbuf(_png)))
+			return false;
+
+		png_write_end(_png, 0);
+
+		return true;
+	}
+
+private:
+
+	std::FILE*  _file;
+	png_structp _png;
+	png_infop   _info;
+};
+
+} // anonymous namespace
+
+RasterExporter::RasterExporter(std::shared_ptr<Document> document, unsigned int numThreads) :
+	_document(document),
+	_numThreads(numThreads),
+	_bandHeight(std::max(optionExportBandHeight.as<unsigned int>(), 1u)),
+	_pixelsPerUnit(1.0),
+	_numBands(0),
+	_window(0),
+	_nextBand(0),
+	_nextToWrite(0),
+	_abort(false) {
+
+	if (_numThreads == 0)
+		_numThreads = optionRenderThreads.as<unsigned int>();
+
+	if (_numThreads == 0)
+		_numThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+}
+
+bool
+RasterExporter::exportPage(unsigned int page, double pixelsPerUnit, const std::string& filename) {
+
+	return exportRegion(_document->getPage(page).getPageBoundingBox(), pixelsPerUnit, filename);
+}
+
+bool
+RasterExporter::exportRegion(
+		const util::box<DocumentPrecision,2>& region,
+		double                                pixelsPerUnit,
+		const std::string&                    filename) {
+
+	_pixelRegion   = OffscreenRenderer::getPixelRegion(region, pixelsPerUnit);
+	_pixelsPerUnit = pixelsPerUnit;
+
+	if (_pixelRegion.area() <= 0) {
+
+		LOG_ERROR(rasterexporterlog) << "nothing to export in " << region << std::endl;
+		return false;
+	}
+
+	unsigned int width  = _pixelRegion.width();
+	unsigned int height = _pixelRegion.height();
+
+	_numBands = (height + _bandHeight - 1)/_bandHeight;
+
+	LOG_DEBUG(rasterexporterlog)
+			<< "exporting " << width << "x" << height << " pixels in "
+			<< _numBands << " bands to " << filename << std::endl;
+
+	PngWriter png;
+	if (!png.open(filename, width, height))
+		return false;
+
+	// two bands per thread keep the threads busy while a band is encoded
+	_window      = 2*_numThreads;
+	_nextBand    = 0;
+	_nextToWrite = 0;
+	_abort       = false;
+	_slots.clear();
+	_slots.resize(_window);
+	for (Band& slot : _slots)
+		slot.done = false;
+
+	boost::thread_group threads;
+	for (unsigned int i = 0; i < std::min(_numThreads, _numBands); i++)
+		threads.create_thread(boost::bind(&RasterExporter::renderBands, this));
+
+	bool success = true;
+
+	for (unsigned int band = 0; band < _numBands; band++) {
+
+		Band& slot = _slots[band%_window];
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			while (!slot.done)
+				_bandDone.wait(lock);
+		}
+
+		LOG_ALL(rasterexporterlog) << "encoding band " << band << std::endl;
+
+		// the render threads don't touch the slot until we free it
+		success = png.writeRows(&slot.pixels[0], width, getBandRegion(band).height());
+
+		{
+			boost::lock_guard<boost::mutex> lock(_mutex);
+
+			slot.done = false;
+			_nextToWrite++;
+
+			if (!success)
+				_abort = true;
+		}
+
+		_slotFree.notify_all();
+
+		if (!success)
+			break;
+	}
+
+	threads.join_all();
+
+	// free the bands
+	_slots.clear();
+
+	if (success)
+		success = png.finish();
+
+	if (!success)
+		LOG_ERROR(rasterexporterlog) << "could not write " << filename << std::endl;
+
+	return success;
+}
+
+void
+RasterExporter::renderBands() {
+
+	// each thread renders its bands on its own
+	OffscreenRenderer renderer(_document, 1);
+
+	while (true) {
+
+		unsigned int band;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			// wait for a free slot
+			while (!_abort && _nextBand < _numBands && _nextBand >= _nextToWrite + _window)
+				_slotFree.wait(lock);
+
+			if (_abort || _nextBand >= _numBands)
+				return;
+
+			band = _nextBand++;
+		}
+
+		Band& slot = _slots[band%_window];
+		util::box<int,2> bandRegion = getBandRegion(band);
+
+		LOG_ALL(rasterexporterlog) << "rendering band " << band << " " << bandRegion << std::endl;
+
+		slot.pixels.resize(static_cast<std::size_t>(bandRegion.width())*bandRegion.height());
+
+		renderer.render(
+				bandRegion,
+				_pixelsPerUnit,
+				&slot.pixels[0],
+				bandRegion.width()*sizeof(sg_gui::skia_pixel_t));
+
+		{
+			boost::lock_guard<boost::mutex> lock(_mutex);
+			slot.done = true;
+		}
+
+		_bandDone.notify_all();
+	}
+}
+
+util::box<int,2>
+RasterExporter::getBandRegion(unsigned int band) {
+
+	int minY = _pixelRegion.min().y() + band*_bandHeight;
+	int maxY = std::min(minY + static_cast<int>(_bandHeight), _pixelRegion.max().y());
+
+	return util::box<int,2>(_pixelRegion.min().x(), minY, _pixelRegion.max().x(), maxY);
+}
+
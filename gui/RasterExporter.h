@@ -0,0 +1,108 @@
+#ifndef YANTA_GUI_RASTER_EXPORTER_H__
+#define YANTA_GUI_RASTER_EXPORTER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <sg_gui/Skia.h>
+#include <util/box.hpp>
+#include <document/Document.h>
+
+/**
+ * Exports parts of a document to PNG at high resolutions with bounded memory. 
+ * The image is rendered in horizontal bands, which are rendered in parallel 
+ * and handed to the PNG encoder in order as soon as they are ready. Only a 
+ * fixed window of bands is held in memory at any time, independent of the 
+ * size of the image.
+ */
+class RasterExporter {
+
+public:
+
+	/**
+	 * Create an exporter for the given document that uses numThreads threads 
+	 * to render bands. If numThreads is zero, the number of threads is given 
+	 * by the program option 'renderThreads', or the number of cores if that 
+	 * is zero as well.
+	 */
+	RasterExporter(std::shared_ptr<Document> document, unsigned int numThreads = 0);
+
+	/**
+	 * Set the height of the bands in pixels. The default is given by the 
+	 * program option 'exportBandHeight'.
+	 */
+	void setBandHeight(unsigned int bandHeight) { _bandHeight = std::max(bandHeight, 1u); }
+
+	/**
+	 * Export the given region in document units with pixelsPerUnit pixels per 
+	 * document unit.
+	 *
+	 * @return false, if the file could not be written.
+	 */
+	bool exportRegion(
+			const util::box<DocumentPrecision,2>& region,
+			double                                pixelsPerUnit,
+			const std::string&                    filename);
+
+	/**
+	 * Export the paper of a page with pixelsPerUnit pixels per document unit.
+	 *
+	 * @return false, if the file could not be written.
+	 */
+	bool exportPage(unsigned int page, double pixelsPerUnit, const std::string& filename);
+
+private:
+
+	// a band of the image being rendered or waiting to be encoded
+	struct Band {
+
+		std::vector<sg_gui::skia_pixel_t> pixels;
+
+		// was the band rendered already?
+		bool done;
+	};
+
+	/**
+	 * Entry point of the render threads. Renders bands until there are none 
+	 * left.
+	 */
+	void renderBands();
+
+	/**
+	 * Get the region of a band in pixels.
+	 */
+	util::box<int,2> getBandRegion(unsigned int band);
+
+	std::shared_ptr<Document> _document;
+
+	unsigned int _numThreads;
+
+	unsigned int _bandHeight;
+
+	// the image currently exported
+	util::box<int,2> _pixelRegion;
+	double           _pixelsPerUnit;
+	unsigned int     _numBands;
+
+	// the bands being rendered or waiting to be encoded, band i is in slot 
+	// i%_window
+	std::vector<Band> _slots;
+	unsigned int      _window;
+
+	// the next band to render and to encode
+	unsigned int _nextBand;
+	unsigned int _nextToWrite;
+
+	// stop rendering bands
+	bool _abort;
+
+	boost::mutex              _mutex;
+	boost::condition_variable _bandDone;
+	boost::condition_variable _slotFree;
+};
+
+#endif // YANTA_GUI_RASTER_EXPORTER_H__
+
@@ -1,6 +1,11 @@
 #ifndef YANTA_GUI_RASTERIZER_H__
 #define YANTA_GUI_RASTERIZER_H__
 
+#include <atomic>
+
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
 #include <util/box.hpp>
 #include <document/Precision.h>
 #include "Quality.h"
@@ -8,11 +13,79 @@
 // forward declaration
 class SkCanvas;
 
+/**
+ * Description of a region that does not show any document content (like 
+ * strokes), i.e., only background or paper. Such regions can be determined 
+ * without rasterizing them. Two regions with equal descriptions look the same.
+ */
+struct UniformContent {
+
+	enum Kind {
+
+		// only the background color
+		Background,
+
+		// only paper, without grid lines
+		Paper,
+
+		// paper with grid lines
+		GridPaper
+	};
+
+	UniformContent() :
+		kind(Background),
+		color(0),
+		scale(0),
+		phaseX(0),
+		phaseY(0) {}
+
+	// what is shown in the region
+	Kind kind;
+
+	// the background color
+	unsigned int color;
+
+	// for grid paper, the quantized pixel scale and position of the grid in 
+	// the region
+	long scale;
+	long phaseX;
+	long phaseY;
+
+	bool operator<(const UniformContent& other) const {
+
+		return
+				boost::tie(kind, color, scale, phaseX, phaseY) <
+				boost::tie(other.kind, other.color, other.scale, other.phaseX, other.phaseY);
+	}
+};
+
+/**
+ * Memory of a rasterizer about what it drew into a region already, such that 
+ * subsequent incremental draws only need to add what is new.
+ */
+struct IncrementalState {
+
+	IncrementalState() :
+		drawnUntilStrokePoint(0),
+		canvasCleared(false),
+		paperDrawn(false) {}
+
+	// the number of the stroke point until which all lines connecting 
+	// previous stroke points have been drawn
+	unsigned long drawnUntilStrokePoint;
+
+	// was the canvas cleared already?
+	bool canvasCleared;
+
+	// was the paper drawn already?
+	bool paperDrawn;
+};
+
 class Rasterizer {
 
 public:
 
-	Rasterizer() : _quality(Auto) {}
+	Rasterizer() : _quality(Auto), _qualityLimit(Best) {}
 
 	/**
 	 * Draw on the given canvas within the given roi.
@@ -21,12 +94,41 @@ public:
 			SkCanvas& canvas,
 			const util::box<DocumentPrecision,2>& roi) = 0;
 
+	/**
+	 * Draw on the given canvas within the given roi with the given quality 
+	 * instead of the one set with setQuality(). Use this to draw with a 
+	 * quality of your own without changing the settings of a rasterizer that 
+	 * is shared with other threads.
+	 */
+	virtual void draw(
+			SkCanvas& canvas,
+			const util::box<DocumentPrecision,2>& roi,
+			Quality quality) = 0;
+
+	/**
+	 * Check whether the given roi shows document content. If not, returns true 
+	 * and describes the region in content. Subclasses can implement this to 
+	 * let callers share the rasterization of equal regions. The default 
+	 * implementation assumes that every region shows content.
+	 */
+	virtual bool getUniformContent(
+			const util::box<DocumentPrecision,2>& /*roi*/,
+			UniformContent& /*content*/) { return false; }
+
 	/**
 	 * Enable or disable incremental drawing mode. Can be implemented by 
 	 * subclasses for quick incremental updates.
 	 */
 	virtual void setIncremental(bool /*incremental*/) {};
 
+	/**
+	 * Set the memory to use for incremental drawing. If set, subsequent calls 
+	 * to draw() only add what is not recorded in state, yet, and update state 
+	 * accordingly. This allows callers to keep track of what was drawn for 
+	 * several regions independently. Pass 0 to unset.
+	 */
+	virtual void setIncrementalState(IncrementalState* /*state*/) {};
+
 	/**
 	 * Set the quality of this rasterizer.
 	 */
@@ -37,10 +139,38 @@ public:
 	 */
 	inline Quality getQuality() { return _quality; }
 
+	/**
+	 * Set the highest quality to pick in Auto mode.
+	 */
+	void setQualityLimit(Quality limit) { _qualityLimit = limit; }
+
+	/**
+	 * Get the highest quality to pick in Auto mode.
+	 */
+	inline Quality getQualityLimit() { return _qualityLimit; }
+
+	/**
+	 * Get the quality the next call to draw() will draw with. For Auto, 
+	 * subclasses can return the quality they pick for their current settings. 
+	 * The default implementation assumes the quality limit.
+	 */
+	virtual Quality getTargetQuality() { return (_quality == Auto ? _qualityLimit : _quality); }
+
+	/**
+	 * Get the quality a call to draw() will draw with, if the canvas is scaled 
+	 * by the given factor in addition to the device transformation. The 
+	 * default implementation ignores the scale.
+	 */
+	virtual Quality getTargetQualityForScale(double /*scale*/) { return getTargetQuality(); }
+
 private:
 
 	// the level of quality to rasterize with
-	Quality _quality;
+	std::atomic<Quality> _quality;
+
+	// the highest quality to pick in Auto mode, set by other threads while 
+	// this rasterizer draws
+	std::atomic<Quality> _qualityLimit;
 };
 
 #endif // YANTA_GUI_RASTERIZER_H__
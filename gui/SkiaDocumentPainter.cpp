@@ -1,28 +1,100 @@
+#include <cstring>
+
+#include <SkBitmap.h>
 #include <SkPath.h>
 #include <SkMaskFilter.h>
 #include <SkBlurMaskFilter.h>
+#include <SkPictureRecorder.h>
 
 #include <util/Logger.h>
+#include "PageRenderCache.h"
 #include "SkiaDocumentPainter.h"
 
 logger::LogChannel skiadocumentpainterlog("skiadocumentpainterlog", "[SkiaDocumentPainter] ");
 
+namespace {
+
+// the appearance of the paper
+
+const char pageRed   = 255;
+const char pageGreen = 255;
+const char pageBlue  = 245;
+
+const char gridRed   = 55;
+const char gridGreen = 55;
+const char gridBlue  = 45;
+
+const double gridSizeX = 5.0;
+const double gridSizeY = 5.0;
+const double gridWidth = 0.03;
+
+// the largest grid cell in pixels for which the grid is drawn with an image 
+// of a cell, instead of line by line
+const double maxGridCellSize = 256.0;
+
+// the largest border of the page shadow in pixels, larger shadows are scaled 
+// up from this size
+const double maxShadowBorder = 64.0;
+
+// the resolution with which the position of the grid is distinguished in 
+// descriptions of uniform regions, in subpixels per pixel
+const double gridPhaseResolution = 16.0;
+
+// does the bounding box of the line from p to q intersect roi?
+inline bool
+lineIntersects(const util::box<PagePrecision,2>& roi, const util::point<PagePrecision,2>& p, const util::point<PagePrecision,2>& q) {
+
+	return
+			std::max(p.x(), q.x()) >= roi.min().x() && std::min(p.x(), q.x()) <= roi.max().x() &&
+			std::max(p.y(), q.y()) >= roi.min().y() && std::min(p.y(), q.y()) <= roi.max().y();
+}
+
+inline bool
+sameStyle(const Style& a, const Style& b) {
+
+	return
+			a.width()    == b.width() &&
+			a.getRed()   == b.getRed() &&
+			a.getGreen() == b.getGreen() &&
+			a.getBlue()  == b.getBlue() &&
+			a.getAlpha() == b.getAlpha();
+}
+
+// the given box scaled by s as a skia rectangle
+inline SkRect
+toScaledRect(const util::box<PagePrecision,2>& box, double s) {
+
+	return SkRect::MakeLTRB(s*box.min().x(), s*box.min().y(), s*box.max().x(), s*box.max().y());
+}
+
+} // anonymous namespace
+
 SkiaDocumentPainter::SkiaDocumentPainter(
 		const sg_gui::skia_pixel_t& clearColor,
 		bool drawPaper) :
 	_clearColor(clearColor),
 	_drawPaper(drawPaper),
-	_drawnUntilStrokePoint(0),
-	_drawnUntilStrokePointTmp(0),
-	_canvasCleared(false),
-	_canvasClearedTmp(false),
-	_paperDrawn(false),
-	_paperDrawnTmp(false),
-	_incremental(false) {}
+	_drawOpenStrokes(true),
+	_incrementalState(0),
+	_memory(&_drawn),
+	_incremental(false),
+	_fullDraw(true),
+	_pictureDrawn(false),
+	_drawQuality(Best),
+	_shadowBorder(0),
+	_shadowScale(0),
+	_shadowBorderSize(0),
+	_gridScale(0) {}
 
 void
 SkiaDocumentPainter::draw(SkCanvas& canvas, const util::box<DocumentPrecision,2>& roi) {
 
+	draw(canvas, roi, getQuality());
+}
+
+void
+SkiaDocumentPainter::draw(SkCanvas& canvas, const util::box<DocumentPrecision,2>& roi, Quality quality) {
+
 	LOG_DEBUG(skiadocumentpainterlog) << "drawing document in " << roi << std::endl;
 
 	setCanvas(canvas);
@@ -36,18 +108,20 @@ SkiaDocumentPainter::draw(SkCanvas& canvas, const util::box<DocumentPrecision,2>
 
 	LOG_DEBUG(skiadocumentpainterlog) << "pixel scale is " << scale << std::endl;
 
-	bool qualitWasAuto = (getQuality() == Auto);
+	// with memory provided by the caller, we always draw incrementally
+	bool wasIncremental = _incremental;
+	if (_incrementalState) {
 
-	if (qualitWasAuto) {
+		_memory = _incrementalState;
+		_incremental = true;
 
-		if (scale < 1)
-			setQuality(Worst);
-		else if (scale < 5)
-			setQuality(Medium);
-		else
-			setQuality(Best);
+	} else {
+
+		_memory = &_drawn;
 	}
 
+	_drawQuality = (quality == Auto ? getQualityForScale(scale) : quality);
+
 	{
 		// make sure reading access to the stroke points are safe
 		boost::shared_lock<boost::shared_mutex> lock(getDocument().getStrokePoints().getMutex());
@@ -56,23 +130,141 @@ SkiaDocumentPainter::draw(SkCanvas& canvas, const util::box<DocumentPrecision,2>
 		getDocument().accept(*this);
 	}
 
-	if (qualitWasAuto)
-		setQuality(Auto);
+	if (_incrementalState) {
+
+		*_incrementalState = _drawnTmp;
+		_incremental = wasIncremental;
+	}
 
 	finish();
 }
 
+Quality
+SkiaDocumentPainter::getTargetQuality() {
+
+	return getTargetQualityForScale(1.0);
+}
+
+Quality
+SkiaDocumentPainter::getTargetQualityForScale(double scale) {
+
+	if (getQuality() != Auto)
+		return getQuality();
+
+	return getQualityForScale(scale*getPixelsPerDeviceUnit().x());
+}
+
+Quality
+SkiaDocumentPainter::getQualityForScale(double scale) {
+
+	Quality quality = Best;
+
+	if (scale < 1)
+		quality = Worst;
+	else if (scale < 3)
+		quality = Medium;
+	else if (scale < 5)
+		quality = Better;
+
+	return std::min(quality, getQualityLimit());
+}
+
+bool
+SkiaDocumentPainter::getUniformContent(const util::box<DocumentPrecision,2>& roi, UniformContent& content) {
+
+	if (!hasDocument() || roi.isZero())
+		return false;
+
+	util::box<DocumentPrecision,2> documentRoi = toDocumentCoordinates(roi);
+
+	// a bit of margin for anti-aliasing
+	double pixelSize = 1.0/getPixelsPerDeviceUnit().x();
+	documentRoi.min() -= util::point<DocumentPrecision,2>(pixelSize, pixelSize);
+	documentRoi.max() += util::point<DocumentPrecision,2>(pixelSize, pixelSize);
+
+	Document& document = getDocument();
+
+	// the input thread might add strokes while we look at them, take the same 
+	// lock as draw()
+	boost::shared_lock<boost::shared_mutex> lock(document.getStrokePoints().getMutex());
+
+	// the page that covers the roi with its paper, if any
+	const Page* paper = 0;
+
+	for (unsigned int i = 0; i < document.numPages(); i++) {
+
+		const Page& page = document.getPage(i);
+
+		// the bounding box contains the content and border of the page
+		if (!page.getBoundingBox().intersects(documentRoi))
+			continue;
+
+		// the roi in page coordinates
+		util::box<PagePrecision,2> pageRoi = page.getTransformation().getInverse().applyTo(documentRoi);
+
+		for (unsigned int s = 0; s < page.numStrokes(); s++) {
+
+			const Stroke& stroke = page.getStroke(s);
+
+			if (stroke.size() > 0 && stroke.getBoundingBox().intersects(pageRoi))
+				return false;
+		}
+
+		if (!_drawPaper)
+			continue;
+
+		// more than one page, or the outline of the page is visible in the roi
+		if (paper ||
+		    pageRoi.min().x() < gridWidth || pageRoi.max().x() > page.getSize().x() - gridWidth ||
+		    pageRoi.min().y() < gridWidth || pageRoi.max().y() > page.getSize().y() - gridWidth)
+			return false;
+
+		paper = &page;
+	}
+
+	content = UniformContent();
+	std::memcpy(&content.color, &_clearColor, std::min(sizeof(content.color), sizeof(_clearColor)));
+
+	if (!paper) {
+
+		content.kind = UniformContent::Background;
+		return true;
+	}
+
+	// are there grid lines in the roi?
+	util::box<PagePrecision,2> pageRoi = paper->getTransformation().getInverse().applyTo(documentRoi);
+	bool gridX = floor((pageRoi.max().x() + gridWidth)/gridSizeX) >= ceil((pageRoi.min().x() - gridWidth)/gridSizeX);
+	bool gridY = floor((pageRoi.max().y() + gridWidth)/gridSizeY) >= ceil((pageRoi.min().y() - gridWidth)/gridSizeY);
+
+	if (!gridX && !gridY) {
+
+		content.kind = UniformContent::Paper;
+		return true;
+	}
+
+	// The grid looks the same in all regions, in which it is at the same 
+	// position (up to a fraction of a pixel).
+	pageRoi = paper->getTransformation().getInverse().applyTo(toDocumentCoordinates(roi));
+	double scale = getPixelsPerDeviceUnit().x()*paper->getScale().x();
+	content.kind   = UniformContent::GridPaper;
+	content.scale  = static_cast<long>(round(scale*gridSizeX*gridPhaseResolution));
+	content.phaseX = static_cast<long>(round(fmod(pageRoi.min().x(), gridSizeX)*scale*gridPhaseResolution)) % std::max(content.scale, 1L);
+	content.phaseY = static_cast<long>(round(fmod(pageRoi.min().y(), gridSizeY)*scale*gridPhaseResolution)) % std::max(content.scale, 1L);
+
+	return true;
+}
+
 bool
 SkiaDocumentPainter::needRedraw() {
 
-	if (!_canvasCleared || !_paperDrawn)
+	if (!_drawn.canvasCleared || !_drawn.paperDrawn)
 		return true;
 
 	if (getDocument().numStrokes() == 0)
 		return false;
 
 	// did we draw all the stroke points?
-	if (_drawnUntilStrokePoint == getDocument().getStrokePoints().size())
+	if (_drawn.drawnUntilStrokePoint == getDocument().getStrokePoints().size())
 		return false;
 
 	return true;
@@ -84,14 +276,14 @@ SkiaDocumentPainter::visit(Document&) {
 	LOG_DEBUG(skiadocumentpainterlog) << "visiting document" << std::endl;
 
 	// reset temporal memory about what we drew already
-	_drawnUntilStrokePointTmp = _drawnUntilStrokePoint;
-	_canvasClearedTmp = _canvasCleared;
-	_paperDrawnTmp = _paperDrawn;
+	_drawnTmp = *_memory;
+
+	_fullDraw = (!_incremental || !_memory->canvasCleared);
 
 	// clear the surface, respecting the clipping
-	if (!_incremental || !_canvasCleared) {
+	if (_fullDraw) {
 		getCanvas().drawColor(SkColorSetRGB(_clearColor.blue, _clearColor.green, _clearColor.red));
-		_canvasClearedTmp = true;
+		_drawnTmp.canvasCleared = true;
 	}
 }
 
@@ -100,8 +292,19 @@ SkiaDocumentPainter::visit(Page& page) {
 
 	LOG_ALL(skiadocumentpainterlog) << "visiting page with roi " << getRoi() << std::endl;
 
-	if ((_incremental && _paperDrawn) || !_drawPaper)
-		return;
+	if (_drawPaper && !(_incremental && _memory->paperDrawn))
+		drawPaper(page);
+
+	// Finished strokes are replayed from a recording if everything has to be 
+	// drawn. Incremental draws add only what is new, strokes are visited for 
+	// that.
+	_pictureDrawn = false;
+	if (_fullDraw)
+		drawPicture(page);
+}
+
+void
+SkiaDocumentPainter::drawPaper(Page& page) {
 
 	// even though the roi might intersect the page's content, it might not 
 	// intersect the paper -- check that here (in page coordinates)
@@ -116,104 +319,409 @@ SkiaDocumentPainter::visit(Page& page) {
 		return;
 	}
 
-	SkPath outline;
 	const util::point<PagePrecision,2>& pageSize = page.getSize();
-	outline.lineTo(pageSize.x(), 0);
-	outline.lineTo(pageSize.x(), pageSize.y());
-	outline.lineTo(0, pageSize.y());
-	outline.lineTo(0, 0);
-	outline.close();
+	SkRect outline = SkRect::MakeWH(pageSize.x(), pageSize.y());
 
-	const char pageRed   = 255;
-	const char pageGreen = 255;
-	const char pageBlue  = 245;
+	// the number of pixels per page unit
+	double scale = getCanvas().getTotalMatrix().getScaleX();
 
-	const char gridRed   = 55;
-	const char gridGreen = 55;
-	const char gridBlue  = 45;
+	// shadow-like thingie
 
-	const double gridSizeX = 5.0;
-	const double gridSizeY = 5.0;
-	const double gridWidth = 0.03;
+	updateShadow(page.getBorderSize(), scale);
+
+	// the nine-patch is drawn in pixels of the shadow image
+	int border = _shadowBorder;
+	getCanvas().save();
+	getCanvas().scale(1.0/_shadowScale, 1.0/_shadowScale);
+	getCanvas().drawImageNine(
+			_shadowImage.get(),
+			_shadowCenter,
+			SkRect::MakeLTRB(
+					-border,
+					-border,
+					pageSize.x()*_shadowScale + border,
+					pageSize.y()*_shadowScale + border),
+			0);
+	getCanvas().restore();
 
 	SkPaint paint;
+	paint.setStyle(SkPaint::kFill_Style);
 
-	// shadow-like thingie
+	if (updateGrid(scale)) {
+
+		// the paper and the grid, as a repeated image of a grid cell
+
+		paint.setShader(_gridShader);
+		paint.setFilterQuality(kLow_SkFilterQuality);
+		getCanvas().drawRect(outline, paint);
+		paint.setShader(0);
+
+	} else {
+
+		// the paper
+
+		paint.setColor(SkColorSetRGB(pageRed, pageGreen, pageBlue));
+		getCanvas().drawRect(outline, paint);
+
+		// the grid, the cells are large enough to contain only a few lines in 
+		// the roi
+
+		paint.setStyle(SkPaint::kStroke_Style);
+		paint.setColor(SkColorSetRGB(gridRed, gridGreen, gridBlue));
+		paint.setStrokeWidth(gridWidth);
+		paint.setAntiAlias(true);
+
+		double startX = std::max(getRoi().min().x(), 0.0);
+		double startY = std::max(getRoi().min().y(), 0.0);
+		double endX   = getRoi().isZero() ? pageSize.x() : std::min(getRoi().max().x(), pageSize.x());
+		double endY   = getRoi().isZero() ? pageSize.y() : std::min(getRoi().max().y(), pageSize.y());
+
+		for (int x = (int)ceil(startX/gridSizeX)*gridSizeX; x <= (int)floor(endX/gridSizeX)*gridSizeX; x += gridSizeX)
+			getCanvas().drawLine(x, startY, x, endY, paint);
+		for (int y = (int)ceil(startY/gridSizeY)*gridSizeY; y <= (int)floor(endY/gridSizeY)*gridSizeY; y += gridSizeY)
+			getCanvas().drawLine(startX, y, endX, y, paint);
+	}
+
+	// the outline
+
+	paint.setStyle(SkPaint::kStroke_Style);
+	paint.setColor(SkColorSetRGB(0.5*pageRed, 0.5*pageGreen, 0.5*pageBlue));
+	paint.setStrokeWidth(gridWidth);
+	paint.setStrokeJoin(SkPaint::kRound_Join);
+	paint.setAntiAlias(true);
+	getCanvas().drawRect(outline, paint);
+
+	_drawnTmp.paperDrawn = true;
+}
+
+void
+SkiaDocumentPainter::updateShadow(double borderSize, double scale) {
+
+	// the pixels per page unit of the shadow image, limited to keep the image 
+	// small for large scales
+	double imageScale = std::min(scale, maxShadowBorder/borderSize);
 
-	// we blur the boundary with a "standard deviation" of 1/10 of the border 
+	if (_shadowImage && imageScale == _shadowScale && borderSize == _shadowBorderSize)
+		return;
+
+	LOG_DEBUG(skiadocumentpainterlog) << "creating page shadow for scale " << imageScale << std::endl;
+
+	// We blur the boundary with a "standard deviation" of 1/10 of the border 
 	// size of the paper -- this makes sure that at the end of the border there 
-	// is almost no trace of the blur anymore
-	auto maskFilter = SkBlurMaskFilter::Make(kOuter_SkBlurStyle, page.getBorderSize()/10.0, SkBlurMaskFilter::kNone_BlurFlag);
-	paint.setMaskFilter(maskFilter);
+	// is almost no trace of the blur anymore.
+	double sigma = borderSize*imageScale/10.0;
+
+	int border = static_cast<int>(ceil(borderSize*imageScale));
+
+	// The paper in the image is large enough that the middle of its edges is 
+	// not affected by the corners, such that the edges can be stretched.
+	int margin = static_cast<int>(ceil(3*sigma));
+	int size   = 2*(border + margin) + 1;
+
+	SkBitmap bitmap;
+	bitmap.allocN32Pixels(size, size);
+	bitmap.eraseColor(SK_ColorTRANSPARENT);
+
+	SkCanvas canvas(bitmap);
+
+	SkPaint paint;
+	paint.setMaskFilter(SkBlurMaskFilter::Make(kOuter_SkBlurStyle, sigma, SkBlurMaskFilter::kNone_BlurFlag));
 	paint.setColor(SkColorSetRGB(0.5*pageRed, 0.5*pageGreen, 0.5*pageBlue));
-	getCanvas().drawPath(outline, paint);
-	paint.setMaskFilter(NULL);
+	canvas.drawRect(SkRect::MakeLTRB(border, border, size - border, size - border), paint);
 
-	// the paper
+	_shadowImage      = SkImage::MakeFromBitmap(bitmap);
+	_shadowCenter     = SkIRect::MakeXYWH(border + margin, border + margin, 1, 1);
+	_shadowBorder     = border;
+	_shadowScale      = imageScale;
+	_shadowBorderSize = borderSize;
+}
 
-	paint.setStyle(SkPaint::kFill_Style);
-	paint.setColor(SkColorSetRGB(pageRed, pageGreen, pageBlue));
-	getCanvas().drawPath(outline, paint);
+bool
+SkiaDocumentPainter::updateGrid(double scale) {
+
+	// the size of a grid cell in pixels
+	double cellSize = gridSizeX*scale;
 
-	// the grid
+	if (cellSize > maxGridCellSize)
+		return false;
 
+	if (_gridShader && scale == _gridScale)
+		return true;
+
+	LOG_DEBUG(skiadocumentpainterlog) << "creating grid for scale " << scale << std::endl;
+
+	int size = std::max(1, static_cast<int>(round(cellSize)));
+
+	SkBitmap bitmap;
+	bitmap.allocN32Pixels(size, size);
+
+	SkCanvas canvas(bitmap);
+	canvas.drawColor(SkColorSetRGB(pageRed, pageGreen, pageBlue));
+
+	// draw the cell in page units
+	canvas.scale(size/gridSizeX, size/gridSizeY);
+
+	SkPaint paint;
 	paint.setStyle(SkPaint::kStroke_Style);
 	paint.setColor(SkColorSetRGB(gridRed, gridGreen, gridBlue));
 	paint.setStrokeWidth(gridWidth);
 	paint.setAntiAlias(true);
 
-	double startX = std::max(getRoi().min().x(), 0.0);
-	double startY = std::max(getRoi().min().y(), 0.0);
-	double endX   = getRoi().isZero() ? pageSize.x() : std::min(getRoi().max().x(), pageSize.x());
-	double endY   = getRoi().isZero() ? pageSize.y() : std::min(getRoi().max().y(), pageSize.y());
+	// the lines on the boundary of the cell, each half of them is continued 
+	// by the neighboring cell
+	canvas.drawLine(0, 0, 0, gridSizeY, paint);
+	canvas.drawLine(gridSizeX, 0, gridSizeX, gridSizeY, paint);
+	canvas.drawLine(0, 0, gridSizeX, 0, paint);
+	canvas.drawLine(0, gridSizeY, gridSizeX, gridSizeY, paint);
 
-	for (int x = (int)ceil(startX/gridSizeX)*gridSizeX; x <= (int)floor(endX/gridSizeX)*gridSizeX; x += gridSizeX)
-		getCanvas().drawLine(x, startY, x, endY, paint);
-	for (int y = (int)ceil(startY/gridSizeY)*gridSizeY; y <= (int)floor(endY/gridSizeY)*gridSizeY; y += gridSizeY)
-		getCanvas().drawLine(startX, y, endX, y, paint);
+	SkMatrix localMatrix = SkMatrix::MakeScale(gridSizeX/size, gridSizeY/size);
 
-	// the outline
+	_gridShader = SkImage::MakeFromBitmap(bitmap)->makeShader(SkShader::kRepeat_TileMode, SkShader::kRepeat_TileMode, &localMatrix);
+	_gridScale  = scale;
 
-	paint.setColor(SkColorSetRGB(0.5*pageRed, 0.5*pageGreen, 0.5*pageBlue));
-	paint.setStrokeWidth(gridWidth);
-	paint.setStrokeCap(SkPaint::kRound_Cap);
-	paint.setStrokeJoin(SkPaint::kRound_Join);
-	getCanvas().drawPath(outline, paint);
+	return true;
+}
+
+void
+SkiaDocumentPainter::drawPicture(Page& page) {
+
+	// the number of pixels per page unit
+	double scale = getCanvas().getTotalMatrix().getScaleX();
+
+	if (scale <= 0)
+		return;
+
+	std::shared_ptr<PageRenderCache> attached = page.getRenderCache();
+	std::shared_ptr<PageRenderCache> cache    = attached;
+
+	if (!cache || !cache->isValidFor(page, scale))
+		cache = std::make_shared<PageRenderCache>(page, scale);
+
+	sk_sp<SkPicture> picture;
+
+	if (cache->hasPicture(_drawQuality)) {
+
+		picture = cache->getPicture(_drawQuality);
+
+	} else {
+
+		// Someone else is recording the page already. Don't wait for it, 
+		// visit the strokes instead.
+		if (cache->isRecording(_drawQuality))
+			return;
+
+		// Claim the recording, such that it happens only once per page. 
+		// Attached caches are shared, replace the cache with an extended copy. 
+		// If this fails, another painter was faster.
+		std::shared_ptr<PageRenderCache> claimed = std::make_shared<PageRenderCache>(*cache);
+		claimed->setRecording(_drawQuality);
+
+		if (!page.replaceRenderCache(attached, claimed))
+			return;
+
+		LOG_DEBUG(skiadocumentpainterlog) << "recording finished strokes of page for scale " << scale << std::endl;
+
+		picture = recordPicture(page, scale);
+
+		// Add the picture to the cache that is attached now (other qualities 
+		// might have been added meanwhile), unless the page changed.
+		std::shared_ptr<PageRenderCache> current = page.getRenderCache();
+		while (current && current->isValidFor(page, scale)) {
+
+			std::shared_ptr<PageRenderCache> extended = std::make_shared<PageRenderCache>(*current);
+			extended->setPicture(_drawQuality, picture);
+
+			if (page.replaceRenderCache(current, extended))
+				break;
+
+			current = page.getRenderCache();
+		}
+	}
+
+	if (picture) {
+
+		// the picture is in pixel units
+		getCanvas().save();
+		getCanvas().scale(1.0/scale, 1.0/scale);
+		getCanvas().drawPicture(picture);
+		getCanvas().restore();
+	}
+
+	_pictureDrawn = true;
+}
+
+sk_sp<SkPicture>
+SkiaDocumentPainter::recordPicture(Page& page, double scale) {
+
+	// strokes of the same style, in the order they are drawn
+	struct StyleGroup {
+
+		const Style*               style;
+		util::box<PagePrecision,2> boundingBox;
+		std::vector<const Stroke*> strokes;
+	};
+
+	std::vector<StyleGroup> groups;
+	util::box<PagePrecision,2> boundingBox(0, 0, 0, 0);
+
+	for (unsigned int i = 0; i < page.numStrokes(); i++) {
+
+		const Stroke& stroke = page.getStroke(i);
+
+		if (!stroke.finished() || stroke.size() <= 1)
+			continue;
+
+		const util::box<PagePrecision,2>& strokeBoundingBox = stroke.getBoundingBox();
+
+		// Find the last group of the same style that the stroke can join. It 
+		// can be drawn earlier than in the page, as long as it does not 
+		// overlap any stroke in between.
+		int group = groups.size() - 1;
+		for (; group >= 0; group--) {
+
+			if (sameStyle(*groups[group].style, stroke.getStyle()))
+				break;
+
+			if (groups[group].boundingBox.intersects(strokeBoundingBox)) {
+
+				group = -1;
+				break;
+			}
+		}
+
+		if (group < 0) {
+
+			groups.push_back(StyleGroup());
+			groups.back().style       = &stroke.getStyle();
+			groups.back().boundingBox = strokeBoundingBox;
+			group = groups.size() - 1;
+
+		} else {
+
+			groups[group].boundingBox.fit(strokeBoundingBox);
+		}
+
+		groups[group].strokes.push_back(&stroke);
+
+		if (boundingBox.isZero())
+			boundingBox = strokeBoundingBox;
+		else
+			boundingBox.fit(strokeBoundingBox);
+	}
+
+	if (groups.empty())
+		return sk_sp<SkPicture>();
+
+	LOG_ALL(skiadocumentpainterlog) << "recording " << groups.size() << " style groups" << std::endl;
+
+	SkRTreeFactory    rtreeFactory;
+	SkPictureRecorder recorder;
+
+	SkCanvas* canvas = recorder.beginRecording(toScaledRect(boundingBox, scale), &rtreeFactory);
+
+	// record in pixel units, such that the painters see the scale they are 
+	// drawing for
+	canvas->scale(scale, scale);
+
+	for (unsigned int g = 0; g < groups.size(); g++)
+		for (unsigned int i = 0; i < groups[g].strokes.size(); i++) {
 
-	_paperDrawnTmp = true;
+			const Stroke& stroke = *groups[g].strokes[i];
+
+			canvas->save();
+			canvas->translate(stroke.getShift().x(), stroke.getShift().y());
+			canvas->scale(stroke.getScale().x(), stroke.getScale().y());
+
+			drawStroke(*canvas, stroke, stroke.begin(), stroke.end());
+
+			canvas->restore();
+		}
+
+	return recorder.finishRecordingAsPicture();
 }
 
 void
 SkiaDocumentPainter::visit(Stroke& stroke) {
 
+	// Leave open strokes to someone else. They are the last strokes in the 
+	// list of stroke points, so not drawing them does not affect what we 
+	// remember to have drawn.
+	if (!_drawOpenStrokes && !stroke.finished())
+		return;
+
 	unsigned long end = stroke.end();
 
-	// end is one beyond the last point of the stroke. _drawnUntilStrokePoint is 
-	// one beyond the last point until which we drew already.  If end is less or 
-	// equal what we drew, there is nothing to do.
+	// replayed from the recording of the page already
+	if (_pictureDrawn && stroke.finished()) {
+
+		_drawnTmp.drawnUntilStrokePoint = std::max(_drawnTmp.drawnUntilStrokePoint, end);
+		return;
+	}
+
+	// end is one beyond the last point of the stroke. drawnUntilStrokePoint 
+	// is one beyond the last point until which we drew already.  If end is 
+	// less or equal what we drew, there is nothing to do.
+
+	unsigned long drawnUntil = _memory->drawnUntilStrokePoint;
 
 	// drawn already?
-	if (_incremental && end <= _drawnUntilStrokePoint)
+	if (_incremental && end <= drawnUntil)
 		return;
 
 	unsigned long begin = stroke.begin();
 
-	if (_incremental && _drawnUntilStrokePoint > 0 && _drawnUntilStrokePoint - 1 > stroke.begin())
-		begin = _drawnUntilStrokePoint - 1;
+	if (_incremental && drawnUntil > 0 && drawnUntil - 1 > stroke.begin()) {
+
+		begin = drawnUntil - 1;
+
+		// Skip the new segments that don't intersect the roi. This way, an 
+		// incremental update of a region costs only as much as the new 
+		// segments inside of it.
+		if (!getRoi().isZero()) {
+
+			const StrokePoints& points = getDocument().getStrokePoints();
+
+			// the pen width at full pressure
+			double margin = stroke.getStyle().width();
+
+			util::box<PagePrecision,2> roi = getRoi();
+			roi.min() -= util::point<PagePrecision,2>(margin, margin);
+			roi.max() += util::point<PagePrecision,2>(margin, margin);
+
+			while (begin + 1 < end && !lineIntersects(roi, points[begin].position, points[begin + 1].position))
+				begin++;
+			while (end > begin + 1 && !lineIntersects(roi, points[end - 2].position, points[end - 1].position))
+				end--;
+
+			if (end <= begin + 1) {
+
+				_drawnTmp.drawnUntilStrokePoint = std::max(_drawnTmp.drawnUntilStrokePoint, stroke.end());
+				return;
+			}
+		}
+	}
 
 	LOG_ALL(skiadocumentpainterlog)
 			<< "drawing stroke (" << stroke.begin() << " - " << stroke.end()
 			<< ") , starting from point " << begin << " until " << end << std::endl;
 
-	if (getQuality() < Best) {
+	drawStroke(getCanvas(), stroke, begin, end);
 
-		_worseStrokePainter.setQuality(getQuality());
-		_worseStrokePainter.draw(getCanvas(), getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+	// remember until which point we drew already in our temporary memory
+	_drawnTmp.drawnUntilStrokePoint = std::max(_drawnTmp.drawnUntilStrokePoint, stroke.end());
+}
+
+void
+SkiaDocumentPainter::drawStroke(SkCanvas& canvas, const Stroke& stroke, unsigned long begin, unsigned long end) {
 
-	} else
-		_bestStrokePainter.draw(getCanvas(), getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+	if (_drawQuality < Better) {
 
-	// remember until which point we drew already in our temporary memory
-	_drawnUntilStrokePointTmp = std::max(_drawnUntilStrokePointTmp, end);
+		_worseStrokePainter.setQuality(_drawQuality);
+		_worseStrokePainter.draw(canvas, getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+
+	} else if (_drawQuality < Best)
+		_betterStrokePainter.draw(canvas, getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+	else
+		_bestStrokePainter.draw(canvas, getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
 }
 
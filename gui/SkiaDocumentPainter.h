@@ -1,6 +1,8 @@
 #ifndef YANTA_SKIA_CANVAS_PAINTER_H__
 #define YANTA_SKIA_CANVAS_PAINTER_H__
 
+#include <SkImage.h>
+#include <SkShader.h>
 #include <sg_gui/Skia.h>
 #include <util/box.hpp>
 
@@ -9,6 +11,7 @@
 #include "SkiaDocumentVisitor.h"
 #include "SkiaStrokeBallPainter.h"
 #include "SkiaStrokeLinePainter.h"
+#include "SkiaStrokePathEffectPainter.h"
 
 class SkiaDocumentPainter : public SkiaDocumentVisitor, public Rasterizer {
 
@@ -25,14 +28,45 @@ public:
 			bool drawPaper = true);
 
 	/**
-	 * Draw the document in the given ROI on the provided canvas. If 
-	 * drawnUntilStroke is non-zero, only an incremental draw is performed, 
-	 * starting from stroke drawnUntilStroke with point drawnUntilStrokePoint.
+	 * Draw the document in the given ROI on the provided canvas. If a state 
+	 * was given to setIncrementalState(), only what is not recorded in this 
+	 * state is drawn, and the state is updated afterwards. Otherwise, the draw 
+	 * is incremental with respect to rememberDrawnElements() if incremental 
+	 * drawing is enabled.
 	 */
 	virtual void draw(
 			SkCanvas& canvas,
 			const util::box<DocumentPrecision,2>& roi = util::box<DocumentPrecision,2>(0, 0, 0, 0));
 
+	/**
+	 * Same as draw() above, but with the given quality instead of the one set 
+	 * with setQuality().
+	 */
+	virtual void draw(
+			SkCanvas& canvas,
+			const util::box<DocumentPrecision,2>& roi,
+			Quality quality);
+
+	/**
+	 * Check whether the given roi (in device units) is covered only by 
+	 * background or paper, using the bounding boxes of the pages and strokes.
+	 */
+	virtual bool getUniformContent(
+			const util::box<DocumentPrecision,2>& roi,
+			UniformContent& content);
+
+	/**
+	 * Get the quality the next call to draw() will draw with. For Auto, this 
+	 * is the quality for the scale of the device transformation.
+	 */
+	virtual Quality getTargetQuality();
+
+	/**
+	 * Get the quality the next call to draw() will draw with on a canvas that 
+	 * is scaled by the given factor.
+	 */
+	virtual Quality getTargetQualityForScale(double scale);
+
 	/**
 	 * Enable or disable incremental drawing. If enabled and 
 	 * rememberDrawnElements() has been called, a subsequent call to draw() will 
@@ -41,15 +75,27 @@ public:
 	 */
 	void setIncremental(bool incremental) { _incremental = incremental; }
 
+	/**
+	 * Use the given memory for incremental drawing instead of the one managed 
+	 * by rememberDrawnElements(). If set, draw() is always incremental with 
+	 * respect to state and updates it afterwards.
+	 */
+	void setIncrementalState(IncrementalState* state) { _incrementalState = state; }
+
+	/**
+	 * Set whether strokes that are still being drawn should be painted. If 
+	 * not, they are left to a live-ink layer and painted once they are 
+	 * finished.
+	 */
+	void setDrawOpenStrokes(bool drawOpenStrokes) { _drawOpenStrokes = drawOpenStrokes; }
+
 	/**
 	 * Remember what was drawn already. Call this method prior an incremental 
 	 * draw, to draw only new elements.
 	 */
 	void rememberDrawnElements() {
 
-		_drawnUntilStrokePoint = _drawnUntilStrokePointTmp;
-		_canvasCleared         = _canvasClearedTmp;
-		_paperDrawn            = _paperDrawnTmp;
+		_drawn = _drawnTmp;
 	}
 
 	/**
@@ -65,9 +111,7 @@ public:
 	 */
 	void resetIncrementalMemory() {
 
-		_drawnUntilStrokePoint = 0;
-		_canvasCleared =  false;
-		_paperDrawn = false;
+		_drawn = IncrementalState();
 	}
 
 	/**
@@ -102,27 +146,102 @@ public:
 
 private:
 
+	/**
+	 * Get the quality to use in Auto mode for the given number of pixels per 
+	 * document unit, up to the quality limit.
+	 */
+	Quality getQualityForScale(double scale);
+
+	/**
+	 * Draw the paper of a page.
+	 */
+	void drawPaper(Page& page);
+
+	/**
+	 * Create the nine-patch image of the page shadow for the given border 
+	 * size and number of pixels per page unit, if it does not exist yet.
+	 */
+	void updateShadow(double borderSize, double scale);
+
+	/**
+	 * Create the repeating shader for paper and grid for the given number of 
+	 * pixels per page unit, if it does not exist yet.
+	 *
+	 * @return false, if the grid cells are too large for a shader. In this 
+	 *         case, paper and grid have to be drawn directly.
+	 */
+	bool updateGrid(double scale);
+
+	/**
+	 * Replay the recorded finished strokes of a page, and record them first 
+	 * if needed. If another painter is recording the page already, nothing 
+	 * is drawn and the strokes have to be visited instead (_pictureDrawn 
+	 * stays false).
+	 */
+	void drawPicture(Page& page);
+
+	/**
+	 * Record the finished strokes of a page for the given number of pixels 
+	 * per page unit. Strokes are grouped by style, as far as this does not 
+	 * change the order of overlapping strokes.
+	 */
+	sk_sp<SkPicture> recordPicture(Page& page, double scale);
+
+	/**
+	 * Draw the points [begin, end) of a stroke with the stroke painter for 
+	 * the quality of the current call to draw().
+	 */
+	void drawStroke(SkCanvas& canvas, const Stroke& stroke, unsigned long begin, unsigned long end);
+
 	// the background color
 	sg_gui::skia_pixel_t _clearColor;
 
 	// shall the paper be drawn as well?
 	bool _drawPaper;
 
-	// the number of the stroke point until which all lines connecting previous 
-	// stroke points have been drawn
-	unsigned long _drawnUntilStrokePoint, _drawnUntilStrokePointTmp;
+	// shall unfinished strokes be drawn?
+	bool _drawOpenStrokes;
 
-	// did we clear the canvas in a previous call already?
-	bool _canvasCleared, _canvasClearedTmp;
+	// what was drawn in previous calls (as remembered by 
+	// rememberDrawnElements()), and what was drawn so far in the current call
+	IncrementalState _drawn, _drawnTmp;
 
-	// did we draw the paper in a previous call already?
-	bool _paperDrawn, _paperDrawnTmp;
+	// memory for incremental drawing provided by the caller, if any
+	IncrementalState* _incrementalState;
+
+	// the memory used in the current call to draw(), either _drawn or 
+	// _incrementalState
+	const IncrementalState* _memory;
 
 	// shall we draw incrementally?
 	bool _incremental;
 
-	SkiaStrokeBallPainter _bestStrokePainter;
-	SkiaStrokeLinePainter _worseStrokePainter;
+	// does the current call to draw() start from a cleared canvas?
+	bool _fullDraw;
+
+	// were the finished strokes of the current page replayed from a picture?
+	bool _pictureDrawn;
+
+	// the quality of the current call to draw(), never Auto
+	Quality _drawQuality;
+
+	// the shadow of pages as a nine-patch image, the size of the shadow in 
+	// the image in pixels, and the pixels per page unit and border size it 
+	// was created for
+	sk_sp<SkImage> _shadowImage;
+	SkIRect        _shadowCenter;
+	int            _shadowBorder;
+	double         _shadowScale;
+	double         _shadowBorderSize;
+
+	// paper and grid as a repeating image of a grid cell, and the pixels per 
+	// page unit it was created for
+	sk_sp<SkShader> _gridShader;
+	double          _gridScale;
+
+	SkiaStrokeBallPainter       _bestStrokePainter;
+	SkiaStrokePathEffectPainter _betterStrokePainter;
+	SkiaStrokeLinePainter       _worseStrokePainter;
 };
 
 #endif // YANTA_SKIA_CANVAS_PAINTER_H__
@@ -18,7 +18,7 @@ SkiaDocumentVisitor::prepare(const util::box<DocumentPrecision,2>& roi) {
 		// according to the current device transformation
 
 		// transform roi downwards
-		setRoi((roi - _pixelOffset)/_pixelsPerDeviceUnit);
+		setRoi(toDocumentCoordinates(roi));
 
 	} else {
 
@@ -72,6 +72,19 @@ protected:
 	 */
 	SkCanvas& getCanvas() { return *_canvas; }
 
+	/**
+	 * Get the number of pixels per document unit of the device transformation.
+	 */
+	const util::point<double,2>& getPixelsPerDeviceUnit() const { return _pixelsPerDeviceUnit; }
+
+	/**
+	 * Transform a region in device units into document coordinates.
+	 */
+	util::box<DocumentPrecision,2> toDocumentCoordinates(const util::box<DocumentPrecision,2>& roi) const {
+
+		return (roi - _pixelOffset)/_pixelsPerDeviceUnit;
+	}
+
 private:
 
 	// the skia canvas to draw to
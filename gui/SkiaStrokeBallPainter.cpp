@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+
 #include <SkCanvas.h>
 #include <SkMaskFilter.h>
 #include <SkBlurMaskFilter.h>
@@ -7,6 +10,17 @@
 #include "SkiaStrokeBallPainter.h"
 #include "util/Logger.h"
 
+namespace {
+
+// the distance between two balls on the screen, in pixels
+const double ballSpacing = 0.5;
+
+// the distance between two balls in pen widths the alpha pressure curve was 
+// made for
+const double referenceBallSpacing = 0.1;
+
+} // anonymous namespace
+
 SkiaStrokeBallPainter::SkiaStrokeBallPainter() {}
 
 void
@@ -37,24 +51,38 @@ SkiaStrokeBallPainter::draw(
 	paint.setColor(SkColorSetRGB(penColorRed, penColorGreen, penColorBlue));
 	paint.setAntiAlias(true);
 
-	auto maskFilter = SkBlurMaskFilter::Make(kNormal_SkBlurStyle, 0.05*penWidth, kNormal_SkBlurStyle);
+	// the blur of the discs in stroke units
+	double blur = 0.05*penWidth;
+
+	auto maskFilter = SkBlurMaskFilter::Make(kNormal_SkBlurStyle, blur, kNormal_SkBlurStyle);
 	paint.setMaskFilter(maskFilter);
 
+	// the number of pixels per stroke unit
+	double scale = canvas.getTotalMatrix().getScaleX();
+
+	_stamps.trim();
+
 	util::point<PagePrecision,2> previousPosition = strokePoints[beginStroke].position;
 	double pos = 0;
 	double length = 0;
-	const double step = 0.1*penWidth;
 
-	// if we start drawing in the middle of the stroke, we need to get the 
+	// Place the balls in a fixed distance on the screen, such that the number 
+	// of balls depends on the length of the stroke on the screen, not in the 
+	// document.
+	const double step = ballSpacing/scale;
+
+	// The balls overlap more or less than at the reference spacing. Change 
+	// the alpha of each ball, such that the balls along a piece of the stroke 
+	// accumulate to the same opacity as before: n balls of alpha a cover like 
+	// 1-(1-a)^n, and there are step/referenceStep reference balls per ball.
+	const double alphaExponent = step/(referenceBallSpacing*penWidth);
+
+	// if we start drawing in the middle of the stroke, we need to know the 
 	// length of the stroke until our beginning
 	if (stroke.begin() < beginStroke) {
 
-		for (unsigned long i = stroke.begin() + 1; i <= beginStroke; i++) {
-			util::point<PagePrecision,2> diff = strokePoints[i].position - strokePoints[i-1].position;
-			length += sqrt(diff.x()*diff.x() + diff.y()*diff.y());
-		}
-
-		pos = length - fmod(length, step) + step;
+		length = strokePoints.getArcLength(stroke.begin(), beginStroke);
+		pos    = length - fmod(length, step) + step;
 	}
 
 	// for each line in the stroke
@@ -73,21 +101,76 @@ SkiaStrokeBallPainter::draw(
 			util::point<PagePrecision,2> p = previousPosition + a*diff;
 			double pressure = (1-a)*strokePoints[i-1].pressure + a*strokePoints[i].pressure;
 
-			double alpha = alphaPressureCurve(pressure);
+			double alpha = std::min(alphaPressureCurve(pressure), 1.0);
+			alpha = 1.0 - std::pow(1.0 - alpha, alphaExponent);
 			double width = widthPressureCurve(pressure);
 
-			paint.setAlpha(alpha*255.0);
+			double radius = 0.5*width*penWidth;
+
+			// the stamps don't cover very large discs, draw them directly
+			if (radius*scale > BrushStamps::MaxRadius) {
+
+				paint.setAlpha(alpha*255.0);
+				canvas.drawCircle(p.x(), p.y(), radius, paint);
+				continue;
+			}
+
+			const BrushStamps::Stamp& stamp = _stamps.get(radius*scale, blur*scale);
+			Batch& batch = _batches[&stamp];
 
-			canvas.drawCircle(p.x(), p.y(), 0.5*width*penWidth, paint);
+			// place the stamp with its center at p, one stamp pixel per device 
+			// pixel
+			batch.transforms.push_back(SkRSXform::Make(
+					1.0/scale, 0,
+					p.x() - stamp.center/scale,
+					p.y() - stamp.center/scale));
+			batch.colors.push_back(SkColorSetARGB(alpha*255.0, penColorRed, penColorGreen, penColorBlue));
 		}
 
 		length += lineLength;
 		previousPosition = nextPosition;
 	}
 
+	flush(canvas);
+
 	return;
 }
 
+void
+SkiaStrokeBallPainter::flush(SkCanvas& canvas) {
+
+	SkPaint paint;
+	paint.setAntiAlias(true);
+
+	// the stamps are placed with sub-pixel accuracy
+	paint.setFilterQuality(kLow_SkFilterQuality);
+
+	for (auto& i : _batches) {
+
+		const BrushStamps::Stamp& stamp = *i.first;
+		Batch& batch = i.second;
+
+		if (batch.transforms.empty())
+			continue;
+
+		_texRects.assign(batch.transforms.size(), SkRect::MakeWH(stamp.image->width(), stamp.image->height()));
+
+		// the discs are of the same color, the order in which they are drawn 
+		// does not matter
+		canvas.drawAtlas(
+				stamp.image.get(),
+				&batch.transforms[0],
+				&_texRects[0],
+				&batch.colors[0],
+				batch.transforms.size(),
+				SkBlendMode::kModulate,
+				0,
+				&paint);
+	}
+
+	_batches.clear();
+}
+
 double
 SkiaStrokeBallPainter::widthPressureCurve(double pressure) {
 
@@ -1,13 +1,23 @@
 #ifndef YANTA_SKIA_STROKE_BALL_PAINTER_H__
 #define YANTA_SKIA_STROKE_BALL_PAINTER_H__
 
+#include <map>
+#include <vector>
+
+#include <SkRSXform.h>
 #include <util/box.hpp>
+#include "BrushStamps.h"
 
 // forward declarations
 class SkCanvas;
 class Stroke;
 class StrokePoints;
 
+/**
+ * Draws strokes as a dense sequence of blurred discs ("balls"). The discs are 
+ * stamped from pre-blurred images (see BrushStamps) in one drawAtlas() call 
+ * per stamp.
+ */
 class SkiaStrokeBallPainter {
 
 public:
@@ -24,8 +34,27 @@ public:
 
 private:
 
+	// the discs to draw with the same stamp
+	struct Batch {
+
+		std::vector<SkRSXform> transforms;
+		std::vector<SkColor>   colors;
+	};
+
+	/**
+	 * Draw all batches and clear them.
+	 */
+	void flush(SkCanvas& canvas);
+
 	double widthPressureCurve(double pressure);
 	double alphaPressureCurve(double pressure);
+
+	BrushStamps _stamps;
+
+	std::map<const BrushStamps::Stamp*, Batch> _batches;
+
+	// the texture rectangles for drawAtlas(), all the same
+	std::vector<SkRect> _texRects;
 };
 
 #endif // YANTA_SKIA_STROKE_BALL_PAINTER_H__
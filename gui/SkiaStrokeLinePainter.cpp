@@ -3,8 +3,17 @@
 #include <document/Stroke.h>
 #include <document/StrokePoints.h>
 #include "SkiaStrokeLinePainter.h"
+#include "StrokeRenderCache.h"
 #include "util/Logger.h"
 
+namespace {
+
+// the tolerance of the outlines for the levels of detail (worst, medium, 
+// better or best), in stroke units
+const double outlineTolerances[StrokeRenderCache::NumOutlineLevels] = { 0.5, 0.1, 0.02 };
+
+} // anonymous namespace
+
 void
 SkiaStrokeLinePainter::draw(
 		SkCanvas& canvas,
@@ -34,6 +43,13 @@ SkiaStrokeLinePainter::draw(
 	paint.setColor(SkColorSetRGB(penColorRed, penColorGreen, penColorBlue));
 	paint.setAntiAlias(true);
 
+	// finished strokes are drawn as a whole, as a single filled outline
+	if (stroke.finished() && beginStroke == stroke.begin() && endStroke == stroke.end()) {
+
+		drawOutline(canvas, strokePoints, stroke, paint);
+		return;
+	}
+
 	unsigned int step = 1;
 
 	if (getQuality() <= Worst)
@@ -60,6 +76,55 @@ SkiaStrokeLinePainter::draw(
 	return;
 }
 
+void
+SkiaStrokeLinePainter::drawOutline(
+		SkCanvas& canvas,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		SkPaint& paint) {
+
+	unsigned int level = 2;
+
+	if (getQuality() <= Worst)
+		level = 0;
+	else if (getQuality() <= Medium)
+		level = 1;
+
+	std::shared_ptr<StrokeRenderCache> cache = stroke.getRenderCache();
+
+	if (!cache || !cache->isValidFor(stroke))
+		cache = std::make_shared<StrokeRenderCache>(stroke);
+
+	const SkPath* outline = cache->getOutline(level);
+
+	if (!outline) {
+
+		_outline.create(strokePoints, stroke, outlineTolerances[level]);
+
+		const std::vector<util::point<double,2>>& polygon = _outline.getPolygon();
+
+		if (polygon.empty())
+			return;
+
+		SkPath path;
+		path.incReserve(polygon.size() + 1);
+		path.moveTo(polygon[0].x(), polygon[0].y());
+		for (unsigned int i = 1; i < polygon.size(); i++)
+			path.lineTo(polygon[i].x(), polygon[i].y());
+		path.close();
+
+		// attached caches are shared, replace the cache with an extended copy
+		cache = std::make_shared<StrokeRenderCache>(*cache);
+		cache->setOutline(level, path);
+		stroke.setRenderCache(cache);
+
+		outline = cache->getOutline(level);
+	}
+
+	paint.setStyle(SkPaint::kFill_Style);
+	canvas.drawPath(*outline, paint);
+}
+
 double
 SkiaStrokeLinePainter::widthPressureCurve(double pressure) {
 
@@ -3,12 +3,19 @@
 
 #include <util/box.hpp>
 #include "Quality.h"
+#include "StrokeOutline.h"
 
 // forward declarations
 class SkCanvas;
+class SkPaint;
 class Stroke;
 class StrokePoints;
 
+/**
+ * Draws strokes as lines with a width that follows the pen pressure. Finished 
+ * strokes are filled as a single outline, which is cached with the stroke. 
+ * Parts of strokes are drawn segment by segment.
+ */
 class SkiaStrokeLinePainter {
 
 public:
@@ -33,13 +40,29 @@ public:
 	 */
 	inline Quality getQuality() { return _quality; }
 
+	/**
+	 * Get the relative width of a line for the given pen pressure.
+	 */
+	static double widthPressureCurve(double pressure);
+
 private:
 
-	double widthPressureCurve(double pressure);
+	/**
+	 * Fill the outline of a whole stroke, and create and cache the outline if 
+	 * needed.
+	 */
+	void drawOutline(
+		SkCanvas& canvas,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		SkPaint& paint);
 
 	double alphaPressureCurve(double pressure);
 
 	Quality _quality;
+
+	// buffers to create outlines
+	StrokeOutline _outline;
 };
 
 #endif // YANTA_SKIA_STROKE_PAINTER_H__
@@ -1,132 +1,190 @@
+#include <algorithm>
+
 #include <SkCanvas.h>
-#include <SkMaskFilter.h>
-#include <SkBlurMaskFilter.h>
 #include <SkPathEffect.h>
 #include <Sk1DPathEffect.h>
-#include <SkCornerPathEffect.h>
 
 #include <document/Stroke.h>
 #include <document/StrokePoints.h>
 #include "SkiaStrokePathEffectPainter.h"
+#include "StrokeRenderCache.h"
 #include "util/Logger.h"
 
-SkiaStrokePathEffectPainter::SkiaStrokePathEffectPainter(SkCanvas& canvas, const StrokePoints& strokePoints) :
-	_canvas(canvas),
-	_strokePoints(strokePoints) {}
-
-sk_sp<SkPathEffect>
-SkiaStrokePathEffectPainter::makePathEffect(
+void
+SkiaStrokePathEffectPainter::draw(
+		SkCanvas& canvas,
+		const StrokePoints& strokePoints,
 		const Stroke& stroke,
-		unsigned int beginStroke,
-		unsigned int endStroke) {
+		const util::box<double,2>& /*roi*/,
+		unsigned long beginStroke,
+		unsigned long endStroke) {
 
-	double penWidth = 0.5*stroke.getStyle().width();
+	if (beginStroke == 0 && endStroke == 0) {
 
-	util::point<PagePrecision,2> previousPosition = _strokePoints[beginStroke].position;
-	double l = 0;
+		beginStroke = stroke.begin();
+		endStroke   = stroke.end();
+	}
 
-	SkPath path;
-	path.moveTo(0, 0);
+	// make sure there are enough points in this stroke to draw it
+	if (stroke.end() - stroke.begin() <= 1 || endStroke - beginStroke <= 1)
+		return;
 
-	static const int increment = 1;
+	unsigned char penColorRed   = stroke.getStyle().getRed();
+	unsigned char penColorGreen = stroke.getStyle().getGreen();
+	unsigned char penColorBlue  = stroke.getStyle().getBlue();
 
-	// forward direction
-	long i = beginStroke;
-	for (; i < endStroke; i += increment) {
+	SkPaint paint;
+	paint.setStrokeCap(SkPaint::kRound_Cap);
+	paint.setColor(SkColorSetRGB(penColorRed, penColorGreen, penColorBlue));
+	paint.setAntiAlias(true);
+
+	if (beginStroke == stroke.begin() && endStroke == stroke.end()) {
 
-		util::point<PagePrecision,2> position = _strokePoints[i].position;
-		util::point<PagePrecision,2> diff = position - previousPosition;
+		const StrokeRenderCache::PathEffectChunks& chunks = getWholeStroke(strokePoints, stroke);
 
-		// length of the stroke until point i
-		l += sqrt(diff.x()*diff.x() + diff.y()*diff.y());
+		for (unsigned int i = 0; i < chunks.size(); i++)
+			drawChunk(canvas, *chunks[i], paint);
 
-		path.lineTo(l, widthPressureCurve(_strokePoints[i].pressure)*penWidth);
+	} else {
 
-		previousPosition = position;
+		// parts of strokes are drawn only once (by incremental draws) or are 
+		// different for each region, don't cache them
+		createChunk(strokePoints, stroke.getStyle().width(), beginStroke, endStroke, _part);
+		drawChunk(canvas, _part, paint);
 	}
-	i -= increment;
+}
+
+const StrokeRenderCache::PathEffectChunks&
+SkiaStrokePathEffectPainter::getWholeStroke(
+		const StrokePoints& strokePoints,
+		const Stroke& stroke) {
 
-	double length = l;
+	std::shared_ptr<StrokeRenderCache> cache = stroke.getRenderCache();
 
-	//backward direction
-	for (; i >= beginStroke; i -= increment) {
+	if (cache && cache->isValidFor(stroke) && cache->hasPathEffect())
+		return cache->getPathEffectChunks();
 
-		util::point<PagePrecision,2> position = _strokePoints[i].position;
-		util::point<PagePrecision,2> diff = position - previousPosition;
+	// attached caches are shared, create an extended copy
+	std::shared_ptr<StrokeRenderCache> extended;
 
-		//length of the stroke until point i
-		l -= sqrt(diff.x()*diff.x() + diff.y()*diff.y());
+	StrokeRenderCache::PathEffectChunks chunks;
 
-		path.lineTo(l, -widthPressureCurve(_strokePoints[i].pressure)*penWidth);
+	if (cache && cache->isValidFor(stroke)) {
 
-		previousPosition = position;
+		extended = std::make_shared<StrokeRenderCache>(*cache);
+
+	} else {
+
+		extended = std::make_shared<StrokeRenderCache>(stroke);
+
+		// points were added to the stroke since the cache was created, keep 
+		// the full chunks (they are shared, not copied) and create only the 
+		// last one again
+		if (cache && cache->isPrefixOf(stroke) && cache->hasPathEffect()) {
+
+			chunks = cache->getPathEffectChunks();
+
+			if (!chunks.empty() && chunks.back()->end - chunks.back()->begin < PointsPerChunk)
+				chunks.pop_back();
+		}
 	}
-	path.lineTo(0, 0);
-	path.close();
 
-	//SkPath backward;
-	//SkMatrix mirror;
-	//mirror.setIdentity();
-	//mirror.setScaleY(-1);
-	//path.transform(mirror, &backward);
-	//path.reverseAddPath(backward);
-
-	auto pressureEffect = SkPath1DPathEffect::Make(path, length, 0, SkPath1DPathEffect::kMorph_Style);
-#if 1
-	return pressureEffect;
-#else
-	SkPathEffect* smoothEffect = new SkCornerPathEffect(SkIntToScalar(200));
-	SkPathEffect* pathEffect   = new SkComposePathEffect(pressureEffect, smoothEffect);
-
-	smoothEffect->unref();
-	pressureEffect->unref();
-
-	return pathEffect;
-#endif
+	double penWidth = stroke.getStyle().width();
+
+	// consecutive chunks share one point
+	unsigned long begin = (chunks.empty() ? stroke.begin() : chunks.back()->end - 1);
+
+	while (begin + 1 < stroke.end()) {
+
+		unsigned long end = std::min(begin + PointsPerChunk, stroke.end());
+
+		std::shared_ptr<StrokeRenderCache::PathEffectChunk> chunk = std::make_shared<StrokeRenderCache::PathEffectChunk>();
+		createChunk(strokePoints, penWidth, begin, end, *chunk);
+		chunks.push_back(chunk);
+
+		begin = end - 1;
+	}
+
+	extended->setPathEffectChunks(chunks);
+	stroke.setRenderCache(extended);
+
+	return extended->getPathEffectChunks();
 }
 
 void
-SkiaStrokePathEffectPainter::draw(
-		const Stroke& stroke,
-		const util::box<double,2>& /*roi*/,
-		unsigned long beginStroke,
-		unsigned long endStroke) {
+SkiaStrokePathEffectPainter::createChunk(
+		const StrokePoints& strokePoints,
+		double penWidth,
+		unsigned long begin,
+		unsigned long end,
+		StrokeRenderCache::PathEffectChunk& chunk) {
+
+	chunk.begin = begin;
+	chunk.end   = end;
+	chunk.centerLine.rewind();
+	chunk.widthProfile.clear();
+
+	chunk.centerLine.incReserve(end - begin);
+	chunk.widthProfile.reserve(end - begin);
+
+	for (unsigned long i = begin; i < end; i++) {
+
+		const StrokePoint& point = strokePoints[i];
+
+		if (i == begin)
+			chunk.centerLine.moveTo(point.position.x(), point.position.y());
+		else
+			chunk.centerLine.lineTo(point.position.x(), point.position.y());
+
+		chunk.widthProfile.push_back(
+				SkPoint::Make(
+						strokePoints.getArcLength(begin, i),
+						0.5*widthPressureCurve(point.pressure)*penWidth));
+	}
 
-	if (beginStroke == 0 && endStroke == 0) {
+	chunk.pathEffect = makePathEffect(chunk.widthProfile);
+}
 
-		beginStroke = stroke.begin();
-		endStroke   = stroke.end();
-	}
+void
+SkiaStrokePathEffectPainter::drawChunk(
+		SkCanvas& canvas,
+		const StrokeRenderCache::PathEffectChunk& chunk,
+		SkPaint& paint) {
 
-	// make sure there are enough points in this stroke to draw it
-	if (stroke.end() - stroke.begin() <= 1)
+	if (!chunk.pathEffect)
 		return;
 
-	unsigned char penColorRed   = stroke.getStyle().getRed();
-	unsigned char penColorGreen = stroke.getStyle().getGreen();
-	unsigned char penColorBlue  = stroke.getStyle().getBlue();
+	paint.setPathEffect(chunk.pathEffect);
+	canvas.drawPath(chunk.centerLine, paint);
+}
 
-	SkPaint paint;
-	paint.setStrokeCap(SkPaint::kRound_Cap);
-	paint.setColor(SkColorSetRGB(penColorRed, penColorGreen, penColorBlue));
-	paint.setAntiAlias(true);
+sk_sp<SkPathEffect>
+SkiaStrokePathEffectPainter::makePathEffect(const std::vector<SkPoint>& widthProfile) {
 
-	//SkMaskFilter* maskFilter = SkBlurMaskFilter::Create(0.05, SkBlurMaskFilter::kNormal_BlurStyle);
-	//paint.setMaskFilter(maskFilter)->unref();
+	if (widthProfile.empty())
+		return 0;
 
-	auto pathEffect = makePathEffect(stroke, beginStroke, endStroke);
-	paint.setPathEffect(pathEffect);
+	double length = widthProfile.back().x();
+
+	if (length <= 0)
+		return 0;
 
 	SkPath path;
-	path.moveTo(_strokePoints[beginStroke].position.x(), _strokePoints[beginStroke].position.y());
+	path.incReserve(2*widthProfile.size() + 2);
+	path.moveTo(0, 0);
 
-	// for each line in the stroke
-	for (unsigned long i = beginStroke + 1; i < endStroke; i++)
-		path.lineTo(_strokePoints[i].position.x(), _strokePoints[i].position.y());
+	// forward direction
+	for (unsigned int i = 0; i < widthProfile.size(); i++)
+		path.lineTo(widthProfile[i].x(), widthProfile[i].y());
+
+	// backward direction
+	for (int i = widthProfile.size() - 1; i >= 0; i--)
+		path.lineTo(widthProfile[i].x(), -widthProfile[i].y());
 
-	_canvas.drawPath(path, paint);
+	path.lineTo(0, 0);
+	path.close();
 
-	return;
+	return SkPath1DPathEffect::Make(path, length, 0, SkPath1DPathEffect::kMorph_Style);
 }
 
 double
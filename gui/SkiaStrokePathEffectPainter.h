@@ -1,21 +1,35 @@
 #ifndef YANTA_SKIA_STROKE_PATH_EFFECT_PAINTER_H__
 #define YANTA_SKIA_STROKE_PATH_EFFECT_PAINTER_H__
 
+#include <vector>
+
+#include <SkPath.h>
+#include <SkRefCnt.h>
 #include <util/box.hpp>
+#include "StrokeRenderCache.h"
 
 // forward declarations
 class SkCanvas;
+class SkPaint;
 class SkPathEffect;
 class Stroke;
 class StrokePoints;
 
+/**
+ * Draws strokes by morphing a pressure dependent width profile along their 
+ * center line. The center line, profile, and path effect of a stroke are 
+ * cached with the stroke in chunks of a fixed number of points. When points 
+ * are added to a stroke, only its last chunk is created again and new chunks 
+ * are appended. Parts of strokes are drawn with a path effect for only this 
+ * part.
+ */
 class SkiaStrokePathEffectPainter {
 
 public:
 
-	SkiaStrokePathEffectPainter(SkCanvas& canvas, const StrokePoints& strokePoints);
-
 	void draw(
+		SkCanvas& canvas,
+		const StrokePoints& strokePoints,
 		const Stroke& stroke,
 		const util::box<double,2>& roi,
 		unsigned long beginStroke = 0,
@@ -23,17 +37,47 @@ public:
 
 private:
 
-	sk_sp<SkPathEffect> makePathEffect(
-			const Stroke& stroke,
-			unsigned int beginStroke,
-			unsigned int endStroke);
+	// the number of points in each cached chunk of a stroke
+	static const unsigned long PointsPerChunk = 64;
+
+	/**
+	 * Get the cached path effect chunks of the whole stroke, and create or 
+	 * extend them if needed.
+	 */
+	const StrokeRenderCache::PathEffectChunks& getWholeStroke(
+			const StrokePoints& strokePoints,
+			const Stroke& stroke);
+
+	/**
+	 * Fill the given chunk with the center line, width profile, and path 
+	 * effect of the points [begin, end) of a stroke.
+	 */
+	void createChunk(
+			const StrokePoints& strokePoints,
+			double penWidth,
+			unsigned long begin,
+			unsigned long end,
+			StrokeRenderCache::PathEffectChunk& chunk);
+
+	/**
+	 * Draw a chunk with its path effect.
+	 */
+	void drawChunk(
+			SkCanvas& canvas,
+			const StrokeRenderCache::PathEffectChunk& chunk,
+			SkPaint& paint);
+
+	/**
+	 * Create a path effect that morphs the given width profile along a path.
+	 */
+	sk_sp<SkPathEffect> makePathEffect(const std::vector<SkPoint>& widthProfile);
 
 	double widthPressureCurve(double pressure);
 
 	double alphaPressureCurve(double pressure);
 
-	SkCanvas&           _canvas;
-	const StrokePoints& _strokePoints;
+	// buffer for parts of strokes
+	StrokeRenderCache::PathEffectChunk _part;
 };
 
 #endif // YANTA_SKIA_STROKE_PATH_EFFECT_PAINTER_H__
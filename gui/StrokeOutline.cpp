@@ -0,0 +1,110 @@
+#include <cmath>
+
+#include <document/Stroke.h>
+#include <document/StrokePoints.h>
+#include "SkiaStrokeLinePainter.h"
+#include "StrokeOutline.h"
+
+namespace {
+
+inline double
+length(const util::point<double,2>& p) {
+
+	return std::sqrt(p.x()*p.x() + p.y()*p.y());
+}
+
+} // anonymous namespace
+
+void
+StrokeOutline::create(const StrokePoints& strokePoints, const Stroke& stroke, double tolerance) {
+
+	_polygon.clear();
+	_centers.clear();
+	_widths.clear();
+	_right.clear();
+
+	if (stroke.end() - stroke.begin() <= 1)
+		return;
+
+	double penWidth = stroke.getStyle().width();
+
+	// pick the samples to use, always including the first and last
+	for (unsigned long i = stroke.begin(); i < stroke.end(); i++) {
+
+		const StrokePoint& point = strokePoints[i];
+
+		if (!_centers.empty() && i != stroke.end() - 1 && length(point.position - _centers.back()) < tolerance)
+			continue;
+
+		// the last sample replaces the previous one if they are too close
+		if (_centers.size() > 1 && i == stroke.end() - 1 && length(point.position - _centers.back()) < tolerance) {
+
+			_centers.pop_back();
+			_widths.pop_back();
+		}
+
+		_centers.push_back(point.position);
+		_widths.push_back(SkiaStrokeLinePainter::widthPressureCurve(point.pressure)*penWidth);
+	}
+
+	if (_centers.size() < 2)
+		return;
+
+	util::point<double,2> normal(0, 0);
+
+	for (unsigned int i = 0; i < _centers.size(); i++) {
+
+		// the direction at this sample, averaged over the adjacent segments
+		util::point<double,2> direction(0, 0);
+
+		if (i > 0) {
+
+			util::point<double,2> d = _centers[i] - _centers[i - 1];
+			if (length(d) > 0)
+				direction += d/length(d);
+		}
+
+		if (i + 1 < _centers.size()) {
+
+			util::point<double,2> d = _centers[i + 1] - _centers[i];
+			if (length(d) > 0)
+				direction += d/length(d);
+		}
+
+		// keep the previous normal for repeated samples and reversals
+		if (length(direction) > 0)
+			normal = util::point<double,2>(-direction.y(), direction.x())/length(direction);
+
+		util::point<double,2> offset = normal*(0.5*_widths[i]);
+
+		// the round start, from the right to the left side
+		if (i == 0)
+			addCap(_centers[i], -offset);
+
+		_polygon.push_back(_centers[i] + offset);
+		_right.push_back(_centers[i] - offset);
+	}
+
+	// the round end, from the left to the right side
+	addCap(_centers.back(), _polygon.back() - _centers.back());
+
+	_polygon.insert(_polygon.end(), _right.rbegin(), _right.rend());
+}
+
+void
+StrokeOutline::addCap(const util::point<double,2>& center, const util::point<double,2>& radius) {
+
+	// Rotate radius by -180 degrees around center in CapSegments steps. The 
+	// first and last corner are part of the sides of the outline already.
+	for (unsigned int i = 1; i < CapSegments; i++) {
+
+		double angle = M_PI*i/CapSegments;
+		double c = std::cos(angle);
+		double s = std::sin(angle);
+
+		_polygon.push_back(center + util::point<double,2>(
+				 c*radius.x() + s*radius.y(),
+				-s*radius.x() + c*radius.y()));
+	}
+}
+
@@ -0,0 +1,61 @@
+#ifndef YANTA_GUI_STROKE_OUTLINE_H__
+#define YANTA_GUI_STROKE_OUTLINE_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+
+// forward declarations
+class Stroke;
+class StrokePoints;
+
+/**
+ * The outline of a stroke as a closed polygon, for output formats that fill 
+ * shapes instead of drawing lines (like PDF or SVG). The width along the 
+ * stroke follows the same pressure-width model as SkiaStrokeLinePainter, the 
+ * ends are rounded.
+ *
+ * The polygon may intersect itself in sharp turns, it has to be filled with 
+ * the non-zero winding rule.
+ */
+class StrokeOutline {
+
+public:
+
+	/**
+	 * Create the outline of the given stroke, in the coordinates of the 
+	 * stroke. Samples closer than tolerance (in the coordinates of the stroke 
+	 * as well) to the previously used sample are skipped, which bounds the 
+	 * size of the polygon for a given output resolution.
+	 */
+	void create(const StrokePoints& strokePoints, const Stroke& stroke, double tolerance);
+
+	/**
+	 * Get the corners of the polygon. Empty if the stroke has less than two 
+	 * points.
+	 */
+	const std::vector<util::point<double,2>>& getPolygon() const { return _polygon; }
+
+private:
+
+	/**
+	 * Add the inner corners of a half circle around center to the polygon, 
+	 * turning from center + radius to center - radius by -180 degrees.
+	 */
+	void addCap(const util::point<double,2>& center, const util::point<double,2>& radius);
+
+	// the number of segments of the half circles at the ends of a stroke
+	static const unsigned int CapSegments = 6;
+
+	std::vector<util::point<double,2>> _polygon;
+
+	// the used samples and their widths
+	std::vector<util::point<double,2>> _centers;
+	std::vector<double>                _widths;
+
+	// the right side of the outline, added in reverse order to the polygon
+	std::vector<util::point<double,2>> _right;
+};
+
+#endif // YANTA_GUI_STROKE_OUTLINE_H__
+
@@ -0,0 +1,56 @@
+#include "StrokeRenderCache.h"
+
+StrokeRenderCache::StrokeRenderCache(const Stroke& stroke) :
+	_begin(stroke.begin()),
+	_end(stroke.end()),
+	_style(stroke.getStyle()),
+	_havePathEffect(false) {
+
+	for (unsigned int i = 0; i < NumOutlineLevels; i++)
+		_haveOutline[i] = false;
+}
+
+bool
+StrokeRenderCache::isValidFor(const Stroke& stroke) const {
+
+	const Style& style = stroke.getStyle();
+
+	return
+			stroke.begin()   == _begin &&
+			stroke.end()     == _end &&
+			style.width()    == _style.width() &&
+			style.getRed()   == _style.getRed() &&
+			style.getGreen() == _style.getGreen() &&
+			style.getBlue()  == _style.getBlue() &&
+			style.getAlpha() == _style.getAlpha();
+}
+
+bool
+StrokeRenderCache::isPrefixOf(const Stroke& stroke) const {
+
+	const Style& style = stroke.getStyle();
+
+	return
+			stroke.begin()   == _begin &&
+			stroke.end()     >= _end &&
+			style.width()    == _style.width() &&
+			style.getRed()   == _style.getRed() &&
+			style.getGreen() == _style.getGreen() &&
+			style.getBlue()  == _style.getBlue() &&
+			style.getAlpha() == _style.getAlpha();
+}
+
+void
+StrokeRenderCache::setOutline(unsigned int level, const SkPath& outline) {
+
+	_outlines[level]    = outline;
+	_haveOutline[level] = true;
+}
+
+void
+StrokeRenderCache::setPathEffectChunks(const PathEffectChunks& chunks) {
+
+	_pathEffectChunks = chunks;
+	_havePathEffect   = true;
+}
+
@@ -0,0 +1,114 @@
+#ifndef YANTA_GUI_STROKE_RENDER_CACHE_H__
+#define YANTA_GUI_STROKE_RENDER_CACHE_H__
+
+#include <memory>
+#include <vector>
+
+#include <SkPath.h>
+#include <SkPathEffect.h>
+
+#include <document/Stroke.h>
+
+/**
+ * Geometry of a stroke that is expensive to create, attached to the stroke 
+ * (see Stroke::setRenderCache()) to be reused by later draws. A cache 
+ * remembers the point range and style of the stroke it was created for, 
+ * erasing parts of the stroke or changing its style invalidates it.
+ *
+ * Once attached to a stroke, a cache is shared between threads and must not 
+ * be changed anymore. To add to it, attach a modified copy.
+ */
+class StrokeRenderCache {
+
+public:
+
+	// the number of levels of detail outlines are cached for
+	static const unsigned int NumOutlineLevels = 3;
+
+	/**
+	 * Create an empty cache for the current state of the given stroke.
+	 */
+	StrokeRenderCache(const Stroke& stroke);
+
+	/**
+	 * Check whether this cache was created for the current state of the given 
+	 * stroke.
+	 */
+	bool isValidFor(const Stroke& stroke) const;
+
+	/**
+	 * Check whether this cache was created for an earlier state of the given 
+	 * stroke, before more points were added to it. Caches of such a prefix 
+	 * can be used to extend the geometry instead of creating it again.
+	 */
+	bool isPrefixOf(const Stroke& stroke) const;
+
+	/**
+	 * Get the outline of the stroke for the given level of detail, or 0, if 
+	 * it was not created yet.
+	 */
+	const SkPath* getOutline(unsigned int level) const { return (_haveOutline[level] ? &_outlines[level] : 0); }
+
+	/**
+	 * Set the outline of the stroke for the given level of detail.
+	 */
+	void setOutline(unsigned int level, const SkPath& outline);
+
+	/**
+	 * A part of the center line of a stroke together with its width profile 
+	 * and the path effect that morphs the profile along it. Consecutive 
+	 * chunks share their first and last point.
+	 */
+	struct PathEffectChunk {
+
+		// the points [begin, end) of the stroke covered by this chunk
+		unsigned long begin;
+		unsigned long end;
+
+		SkPath centerLine;
+
+		// pairs of arc length from the beginning of the chunk and half the 
+		// width, one for each point
+		std::vector<SkPoint> widthProfile;
+
+		// 0, if the chunk has no length
+		sk_sp<SkPathEffect> pathEffect;
+	};
+
+	typedef std::vector<std::shared_ptr<const PathEffectChunk> > PathEffectChunks;
+
+	/**
+	 * Check whether the path effect chunks of the stroke were created 
+	 * already.
+	 */
+	bool hasPathEffect() const { return _havePathEffect; }
+
+	/**
+	 * Get the chunks of the center line of the stroke, to be drawn with their 
+	 * path effects. Chunks are immutable and shared with copies of this 
+	 * cache, such that extending a stroke only has to create its last chunks 
+	 * again.
+	 */
+	const PathEffectChunks& getPathEffectChunks() const { return _pathEffectChunks; }
+
+	/**
+	 * Set the path effect chunks of the stroke.
+	 */
+	void setPathEffectChunks(const PathEffectChunks& chunks);
+
+private:
+
+	// the state of the stroke this cache was created for
+	unsigned long _begin;
+	unsigned long _end;
+	Style         _style;
+
+	SkPath _outlines[NumOutlineLevels];
+	bool   _haveOutline[NumOutlineLevels];
+
+	PathEffectChunks _pathEffectChunks;
+	bool             _havePathEffect;
+};
+
+#endif // YANTA_GUI_STROKE_RENDER_CACHE_H__
+
@@ -1,46 +1,204 @@
+#include <algorithm>
+#include <cmath>
+
+#include <boost/timer/timer.hpp>
+#include <SkBitmap.h>
+#include <SkCanvas.h>
+
+#include <util/ProgramOptions.h>
 #include "TexturePyramid.h"
 
 logger::LogChannel texturepyramidlog("texturepyramidlog", "[TexturePyramid] ");
 
+extern util::ProgramOption optionMaxRasterizationTimePerFrame;
+
 TexturePyramid::TexturePyramid() :
-	_numTiles(100, 100),
-	_tileMapping(_numTiles.x(), _numTiles.y()) {}
+	_level(0),
+	_pageTiles(AtlasTiles),
+	_quadTiles(0, 0, 0, 0),
+	_haveBackdrop(false),
+	_quadsChanged(false),
+	_tileContent(boost::extents[AtlasTiles][AtlasTiles]),
+	_shown(boost::extents[AtlasTiles][AtlasTiles]),
+	_upToDate(boost::extents[AtlasTiles][AtlasTiles]),
+	_tileQualities(boost::extents[AtlasTiles][AtlasTiles]),
+	_rasterizationBudget(optionMaxRasterizationTimePerFrame.as<double>()*1e-3),
+	_tileData(TileWidth*TileHeight) {
+
+	for (unsigned int x = 0; x < AtlasTiles; x++)
+		for (unsigned int y = 0; y < AtlasTiles; y++) {
+
+			_shown[x][y]    = false;
+			_upToDate[x][y] = false;
+		}
+}
 
 void
 TexturePyramid::render(const util::box<float,2>& roi, Rasterizer& rasterizer) {
 
-	updateTiles(roi, rasterizer);
+	if (_atlas.empty())
+		createAtlas(_atlas);
+
+	int level = getZoomLevel();
+	if (level != _level)
+		setLevel(level);
+
+	util::box<int, 2> tiles = getTiles(roi);
+
+	updateTiles(tiles, rasterizer);
+
+	// the backdrop is not needed anymore once all visible tiles are shown
+	if (_haveBackdrop && allShown(tiles)) {
+
+		LOG_DEBUG(texturepyramidlog) << "all visible tiles of level " << _level << " are shown, dropping backdrop" << std::endl;
+
+		_haveBackdrop = false;
+	}
+
+	// the quads only change with the visible or shown tiles
+	if (_quadsChanged || !(tiles.min() == _quadTiles.min() && tiles.max() == _quadTiles.max())) {
+
+		updateQuads(tiles);
+		_quadTiles    = tiles;
+		_quadsChanged = false;
+	}
 
 	glEnable(GL_TEXTURE_2D);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	util::box<int, 2> tiles = getTiles(roi);
+	if (_haveBackdrop)
+		drawAtlas(_backdropAtlas);
+
+	drawAtlas(_atlas);
+
+	glDisable(GL_BLEND);
+}
+
+void
+TexturePyramid::markDirty(const util::box<float,2>& region) {
+
+	// all tiles are dirty until the atlas exists
+	if (_atlas.empty())
+		return;
+
+	util::box<int, 2> tiles = getTiles(region);
 
 	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
 		for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
 
-			LOG_ALL(texturepyramidlog) << "rendering tile " << x << ", " << y << std::endl;
-
 			util::point<int, 2> index = _tileMapping.map(util::point<int, 2>(x, y));
-			_tiles[index.x()][index.y()].bind();
+			_upToDate[index.x()][index.y()] = false;
+		}
+}
 
-			// tile position in world coordinates
-			util::box<double, 2> tilePosition(
-					 x   *TileWidth,  y   *TileHeight,
-					(x+1)*TileWidth, (y+1)*TileHeight);
-
-			glBegin(GL_QUADS);
-			glTexCoord2d(0, 0); glVertex2d(tilePosition.min().x(), tilePosition.min().y());
-			glTexCoord2d(1, 0); glVertex2d(tilePosition.max().x(), tilePosition.min().y());
-			glTexCoord2d(1, 1); glVertex2d(tilePosition.max().x(), tilePosition.max().y());
-			glTexCoord2d(0, 1); glVertex2d(tilePosition.min().x(), tilePosition.max().y());
-			glEnd();
-
-			_tiles[index.x()][index.y()].unbind();
+void
+TexturePyramid::createAtlas(Atlas& atlas) {
+
+	GLint maxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+	// the largest power of two of tiles that fits into a texture
+	_pageTiles = AtlasTiles;
+	while (_pageTiles > 1 && _pageTiles*static_cast<int>(std::max(TileWidth, TileHeight)) > maxTextureSize)
+		_pageTiles /= 2;
+
+	int numPages = (AtlasTiles/_pageTiles)*(AtlasTiles/_pageTiles);
+
+	if (numPages > 1)
+		LOG_USER(texturepyramidlog)
+				<< "maximal texture size is " << maxTextureSize
+				<< ", splitting the atlas into " << numPages << " pages of "
+				<< _pageTiles << "x" << _pageTiles << " tiles" << std::endl;
+
+	atlas.resize(numPages);
+
+	for (int i = 0; i < numPages; i++) {
+
+		atlas[i].texture.reset(new sg_gui::Texture(_pageTiles*TileWidth, _pageTiles*TileHeight, GL_RGBA));
+		atlas[i].quads.reset(new QuadBatch());
+	}
+}
+
+void
+TexturePyramid::drawAtlas(Atlas& atlas) {
+
+	for (unsigned int i = 0; i < atlas.size(); i++) {
+
+		if (atlas[i].quads->size() == 0)
+			continue;
+
+		atlas[i].texture->bind();
+		atlas[i].quads->draw();
+		atlas[i].texture->unbind();
+	}
+}
+
+int
+TexturePyramid::getZoomLevel() {
+
+	GLdouble modelview[16];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+
+	// the number of pixels per world unit
+	double scale = std::sqrt(modelview[0]*modelview[0] + modelview[1]*modelview[1]);
+
+	if (scale <= 0)
+		return _level;
+
+	int level = static_cast<int>(std::floor(std::log2(scale) + 0.5));
+
+	return std::max(MinLevel, std::min(MaxLevel, level));
+}
+
+void
+TexturePyramid::setLevel(int level) {
+
+	LOG_DEBUG(texturepyramidlog) << "switching from level " << _level << " to " << level << std::endl;
+
+	// Keep the current content as the backdrop, unless it is incomplete and 
+	// there is a backdrop already. In this case, the previous backdrop shows 
+	// more. The quads are in world coordinates, the backdrop is scaled with 
+	// the zoom.
+	if (!_haveBackdrop || allShown(_quadTiles)) {
+
+		LOG_DEBUG(texturepyramidlog) << "keeping content of level " << _level << " as backdrop" << std::endl;
+
+		if (_backdropAtlas.empty())
+			createAtlas(_backdropAtlas);
+
+		std::swap(_atlas, _backdropAtlas);
+
+		_haveBackdrop = true;
+	}
+
+	_level = level;
+
+	// nothing is drawn for the new level yet
+	for (unsigned int x = 0; x < AtlasTiles; x++)
+		for (unsigned int y = 0; y < AtlasTiles; y++) {
+
+			_shown[x][y]    = false;
+			_upToDate[x][y] = false;
 		}
 
-	glDisable(GL_BLEND);
+	_quadTiles    = util::box<int, 2>(0, 0, 0, 0);
+	_quadsChanged = true;
+}
+
+bool
+TexturePyramid::allShown(const util::box<int,2>& tiles) {
+
+	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+		for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
+
+			util::point<int, 2> tile(x, y);
+
+			if (!shows(_tileMapping.map(tile), tile))
+				return false;
+		}
+
+	return true;
 }
 
 util::box<int,2>
@@ -55,22 +213,133 @@ TexturePyramid::getTiles(const util::box<float,2>& roi) {
 }
 
 void
-TexturePyramid::updateTiles(const util::box<float,2>& roi, Rasterizer& rasterizer) {
+TexturePyramid::updateTiles(const util::box<int,2>& tiles, Rasterizer& rasterizer) {
 
-	util::box<int, 2> tiles = getTiles(roi);
+	Quality quality = rasterizer.getTargetQualityForScale(getLevelScale());
+
+	boost::timer::cpu_timer timer;
+
+	// Draw the tiles that don't show anything yet in the first pass, and the 
+	// tiles with outdated content in the second.
+	for (int pass = 0; pass < 2; pass++)
+		for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+			for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
+
+				util::point<int, 2> tile(x, y);
+				util::point<int, 2> index = _tileMapping.map(tile);
+
+				bool shown = shows(index, tile);
+
+				if ((pass == 0) == shown)
+					continue;
+
+				// skip tiles that show what they should already, at least with 
+				// the target quality
+				if (
+						shown &&
+						_upToDate[index.x()][index.y()] &&
+						_tileQualities[index.x()][index.y()] >= quality)
+					continue;
+
+				if (timer.elapsed().wall*1e-9 >= _rasterizationBudget) {
+
+					LOG_ALL(texturepyramidlog) << "rasterization budget exceeded, leaving remaining tiles for the next frames" << std::endl;
+					return;
+				}
+
+				updateTile(tile, index, quality, rasterizer);
+			}
+}
+
+void
+TexturePyramid::updateTile(
+		const util::point<int,2>& tile,
+		const util::point<int,2>& index,
+		Quality quality,
+		Rasterizer& rasterizer) {
+
+	LOG_ALL(texturepyramidlog) << "updating tile " << tile << std::endl;
+
+	// a tile that shows something else so far changes the quads
+	if (!shows(index, tile))
+		_quadsChanged = true;
+
+	_shown[index.x()][index.y()]         = true;
+	_upToDate[index.x()][index.y()]      = true;
+	_tileContent[index.x()][index.y()]   = tile;
+	_tileQualities[index.x()][index.y()] = quality;
+
+	// the region covered by the tile in world coordinates
+	util::box<double,2> tileRegion = getTileRegion(tile);
+
+	// wrap the data in a skia bitmap, with the upper left of the tile at 
+	// (0,0), and scale world units to the pixels of the level
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(TileWidth, TileHeight));
+	bitmap.setPixels(&_tileData[0]);
+
+	SkCanvas canvas(bitmap);
+	canvas.scale(getLevelScale(), getLevelScale());
+	canvas.translate(-tileRegion.min().x(), -tileRegion.min().y());
+
+	boost::timer::cpu_timer timer;
+
+	rasterizer.draw(
+			canvas,
+			util::box<DocumentPrecision,2>(
+					tileRegion.min().x(),
+					tileRegion.min().y(),
+					tileRegion.max().x(),
+					tileRegion.max().y()),
+			quality);
+
+	if (_qualityGovernor)
+		_qualityGovernor->addTileTime(quality, timer.elapsed().wall*1e-9);
+
+	util::point<int, 2> position = getPagePosition(index);
+
+	_atlas[getPage(index)].texture->loadData(
+			&_tileData[0],
+			util::box<int,2>(
+					 position.x()   *TileWidth,  position.y()   *TileHeight,
+					(position.x()+1)*TileWidth, (position.y()+1)*TileHeight));
+}
+
+void
+TexturePyramid::updateQuads(const util::box<int,2>& tiles) {
+
+	LOG_ALL(texturepyramidlog) << "updating quads for tiles " << tiles << std::endl;
+
+	for (unsigned int i = 0; i < _atlas.size(); i++)
+		_atlas[i].quads->clear();
+
+	const float pageWidth  = _pageTiles*TileWidth;
+	const float pageHeight = _pageTiles*TileHeight;
 
 	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
 		for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
 
-			LOG_ALL(texturepyramidlog) << "updating tile " << x << ", " << y << std::endl;
-
 			util::point<int, 2> index = _tileMapping.map(util::point<int, 2>(x, y));
 
-			// TODO: use rasterizer
-			sg_gui::skia_pixel_t data[TileWidth*TileHeight];
-			for (unsigned int i = 0; i < TileWidth*TileHeight; i++)
-				data[i] = sg_gui::skia_pixel_t(x%255, y%255, 0, 255);
+			// tiles that were not drawn yet show the background
+			if (!shows(index, util::point<int, 2>(x, y)))
+				continue;
+
+			// tile position in world coordinates
+			util::box<double, 2> tileRegion = getTileRegion(util::point<int, 2>(x, y));
+			util::box<float, 2>  tilePosition(
+					tileRegion.min().x(), tileRegion.min().y(),
+					tileRegion.max().x(), tileRegion.max().y());
+
+			// the part of the page showing the tile, inset by half a texel to 
+			// not bleed into the neighboring tiles of the page
+			util::point<int, 2> position = getPagePosition(index);
+			util::box<float, 2> texCoords(
+					( position.x()   *TileWidth  + 0.5)/pageWidth,
+					( position.y()   *TileHeight + 0.5)/pageHeight,
+					((position.x()+1)*TileWidth  - 0.5)/pageWidth,
+					((position.y()+1)*TileHeight - 0.5)/pageHeight);
 
-			_tiles[index.x()][index.y()].loadData(data, util::box<int,2>(0, 0, TileWidth, TileHeight));
+			_atlas[getPage(index)].quads->add(tilePosition, texCoords);
 		}
 }
@@ -1,59 +1,247 @@
 #ifndef YANTARANTANA_GUI_TEXTURE_PYRAMID_H__
 #define YANTARANTANA_GUI_TEXTURE_PYRAMID_H__
 
+#include <cmath>
+#include <memory>
+#include <vector>
+
 #include <boost/multi_array.hpp>
+#include <sg_gui/Skia.h>
 #include <sg_gui/Texture.h>
-#include <util/torus_mapping.hpp>
+#include "QuadBatch.h"
+#include "QualityGovernor.h"
 #include "Rasterizer.h"
-
+#include "TileSize.h"
+#include "TorusMapping.h"
+
+/**
+ * Shows a grid of tiles. The tiles are stored in a single atlas texture and 
+ * drawn with one call from a vertex buffer, which is rebuilt only when the 
+ * set of visible tiles changes.
+ *
+ * The tiles have the size YANTA_TILE_SIZE. The atlas holds a power-of-two 
+ * grid of tiles, such that tiles are mapped to their place in the atlas with 
+ * a bitwise and. If the OpenGl implementation does not support textures as 
+ * large as the atlas, the atlas is split into several pages, each of them 
+ * drawn with its own call.
+ *
+ * Tiles are drawn with the target quality of the rasterizer. If the target 
+ * quality is raised (e.g., by a QualityGovernor), tiles of a lower quality 
+ * are drawn again. If it is lowered, existing tiles are kept until they 
+ * change.
+ *
+ * The time spent on drawing tiles per frame is limited by the program option 
+ * 'maxRasterizationTimePerFrame'. Tiles that did not show anything so far are 
+ * drawn first, then tiles with outdated content. Tiles that don't fit into the 
+ * budget are left for the next frames. Until then, outdated tiles show their 
+ * previous content and new tiles are not drawn at all.
+ *
+ * Tiles are rasterized for the level of the pyramid that is closest to the 
+ * current zoom (the scale of the OpenGl modelview matrix): tiles of level l 
+ * cover TileWidth/2^l world units. When the level changes, the content of the 
+ * previous level is kept as a backdrop behind the new tiles, where it is 
+ * scaled with the zoom like the tiles, until all visible tiles of the new 
+ * level are shown.
+ */
 class TexturePyramid {
 
 public:
 
-	static const unsigned int TileWidth  = 64;
-	static const unsigned int TileHeight = 64;
+	static const unsigned int TileWidth  = YANTA_TILE_SIZE;
+	static const unsigned int TileHeight = YANTA_TILE_SIZE;
 
 	TexturePyramid();
 
 	void render(const util::box<float, 2>& roi, Rasterizer& rasterizer);
 
+	/**
+	 * Set a governor to report the time it takes to rasterize tiles to.
+	 */
+	void setQualityGovernor(std::shared_ptr<QualityGovernor> governor) { _qualityGovernor = governor; }
+
+	/**
+	 * Mark the tiles intersecting the given region in world coordinates as 
+	 * dirty, such that they get updated in the next call to render().
+	 */
+	void markDirty(const util::box<float, 2>& region);
+
 private:
 
-	class Tile : public sg_gui::Texture {
+	// the number of tiles in the atlas in each direction, enough to cover 
+	// 8192 pixels
+	static const unsigned int AtlasTiles = 8192/YANTA_TILE_SIZE;
 
-	public:
+	/**
+	 * A part of the atlas in a texture of its own, with the quads to draw 
+	 * from it.
+	 */
+	struct AtlasPage {
 
-		Tile() : sg_gui::Texture(TexturePyramid::TileWidth, TexturePyramid::TileHeight, GL_RGBA) {}
+		std::unique_ptr<sg_gui::Texture> texture;
+		std::unique_ptr<QuadBatch>       quads;
 	};
 
+	typedef std::vector<AtlasPage> Atlas;
+
+	// the range of levels, i.e., zooms from 1/16 to 16
+	static const int MinLevel = -4;
+	static const int MaxLevel =  4;
+
+	/**
+	 * Get the number of pixels per world unit of the current level.
+	 */
+	inline double getLevelScale() { return std::ldexp(1.0, _level); }
+
 	/**
-	 * Get the integer coordinates of the tile that contains the given world
-	 * coordinate.
+	 * Get the integer coordinates of the tile of the current level that 
+	 * contains the given world coordinate.
 	 */
 	inline util::point<int, 2> getTileCoordinates(const util::point<float, 2>& worldCoordinates) {
 
 		return util::point<int, 2>(
-				worldCoordinates.x()/static_cast<int>(TileWidth)  - (worldCoordinates.x() < 0 ? 1 : 0),
-				worldCoordinates.y()/static_cast<int>(TileHeight) - (worldCoordinates.y() < 0 ? 1 : 0));
+				std::floor(worldCoordinates.x()*getLevelScale()/TileWidth),
+				std::floor(worldCoordinates.y()*getLevelScale()/TileHeight));
+	}
+
+	/**
+	 * Get the region covered by a tile of the current level in world 
+	 * coordinates.
+	 */
+	inline util::box<double, 2> getTileRegion(const util::point<int, 2>& tile) {
+
+		double scale = getLevelScale();
+
+		return util::box<double, 2>(
+				 tile.x()   *TileWidth/scale,  tile.y()   *TileHeight/scale,
+				(tile.x()+1)*TileWidth/scale, (tile.y()+1)*TileHeight/scale);
+	}
+
+	/**
+	 * Get the level closest to the current zoom of the OpenGl modelview 
+	 * matrix.
+	 */
+	int getZoomLevel();
+
+	/**
+	 * Switch to another level. Keeps the current content as the backdrop, 
+	 * unless it is incomplete and there is a backdrop already.
+	 */
+	void setLevel(int level);
+
+	/**
+	 * Check whether all of the given tiles are shown, possibly outdated.
+	 */
+	bool allShown(const util::box<int, 2>& tiles);
+
+	/**
+	 * Split the atlas into pages as large as the OpenGl implementation allows, 
+	 * and create the textures of the given atlas.
+	 */
+	void createAtlas(Atlas& atlas);
+
+	/**
+	 * Get the page of the atlas holding the tile with the given index.
+	 */
+	inline unsigned int getPage(const util::point<int, 2>& index) {
+
+		return (index.y()/_pageTiles)*(AtlasTiles/_pageTiles) + index.x()/_pageTiles;
+	}
+
+	/**
+	 * Get the position of the tile with the given index in its page.
+	 */
+	inline util::point<int, 2> getPagePosition(const util::point<int, 2>& index) {
+
+		return util::point<int, 2>(index.x() & (_pageTiles - 1), index.y() & (_pageTiles - 1));
 	}
 
+	/**
+	 * Draw the quads of all pages of the given atlas.
+	 */
+	void drawAtlas(Atlas& atlas);
+
 	/**
 	 * Get the integer roi of tiles containing the given roi in world coordinates.
 	 */
 	util::box<int, 2> getTiles(const util::box<float, 2>& roi);
 
 	/**
-	 * Redraw the tiles.
+	 * Redraw the tiles that are not up-to-date, as far as the rasterization 
+	 * budget allows.
+	 */
+	void updateTiles(const util::box<int, 2>& tiles, Rasterizer& rasterizer);
+
+	/**
+	 * Draw a single tile with the given quality into its place in the atlas.
+	 */
+	void updateTile(
+			const util::point<int, 2>& tile,
+			const util::point<int, 2>& index,
+			Quality quality,
+			Rasterizer& rasterizer);
+
+	/**
+	 * Check whether the atlas tile with the given index shows the given tile, 
+	 * possibly outdated.
 	 */
-	void updateTiles(const util::box<float, 2>& roi, Rasterizer& rasterizer);
+	inline bool shows(const util::point<int, 2>& index, const util::point<int, 2>& tile) {
+
+		return _shown[index.x()][index.y()] && _tileContent[index.x()][index.y()] == tile;
+	}
 
-	util::point<int, 2> _numTiles;
+	/**
+	 * Rebuild the quads to draw the given tiles, as far as they are shown.
+	 */
+	void updateQuads(const util::box<int, 2>& tiles);
 
 	// mapping from tile coordinates to tile indices
-	torus_mapping<int> _tileMapping;
+	TorusMapping<AtlasTiles, AtlasTiles> _tileMapping;
+
+	// the level the tiles are rasterized for
+	int _level;
+
+	// the pages holding all tiles, with the quads to draw the visible tiles, 
+	// created on the first call to render()
+	Atlas _atlas;
+
+	// the number of tiles in each direction of a page, a power of two
+	int _pageTiles;
+
+	// the tiles the quads were built for
+	util::box<int, 2> _quadTiles;
+
+	// the content of the previous level and its quads, shown behind the tiles 
+	// until they are complete
+	Atlas _backdropAtlas;
+	bool  _haveBackdrop;
+
+	// did the set of shown tiles change since the quads were built?
+	bool _quadsChanged;
+
+	// the tile coordinates each tile was last updated for
+	typedef boost::multi_array<util::point<int, 2>, 2> tile_content_type;
+	tile_content_type _tileContent;
+
+	// was a tile drawn for its content coordinates already?
+	typedef boost::multi_array<bool, 2> shown_type;
+	shown_type _shown;
+
+	// is the content of a tile up-to-date?
+	typedef boost::multi_array<bool, 2> up_to_date_type;
+	up_to_date_type _upToDate;
+
+	// the quality each tile was drawn with
+	typedef boost::multi_array<Quality, 2> tile_qualities_type;
+	tile_qualities_type _tileQualities;
+
+	// gets the time it takes to rasterize tiles, if set
+	std::shared_ptr<QualityGovernor> _qualityGovernor;
+
+	// the maximal time to spend on drawing tiles per frame in seconds
+	double _rasterizationBudget;
 
-	// the tiles
-	Tile _tiles[100][100];
+	// the pixels of the tile that is drawn
+	std::vector<sg_gui::skia_pixel_t> _tileData;
 };
 
 #endif // YANTARANTANA_GUI_TEXTURE_PYRAMID_H__
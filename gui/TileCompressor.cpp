@@ -0,0 +1,107 @@
+#include <cstring>
+#include "TileCompressor.h"
+
+static_assert(sizeof(sg_gui::skia_pixel_t) == sizeof(boost::uint32_t), "skia pixels are expected to be 32 bit");
+
+namespace {
+
+inline boost::uint32_t
+toWord(const sg_gui::skia_pixel_t& pixel) {
+
+	boost::uint32_t word;
+	std::memcpy(&word, &pixel, sizeof(word));
+	return word;
+}
+
+inline void
+flushLiterals(
+		const sg_gui::skia_pixel_t* pixels,
+		std::size_t begin,
+		std::size_t end,
+		TileCompressor::data_type& data,
+		boost::uint32_t literalFlag) {
+
+	if (begin == end)
+		return;
+
+	data.push_back(literalFlag | static_cast<boost::uint32_t>(end - begin));
+
+	for (std::size_t i = begin; i < end; i++)
+		data.push_back(toWord(pixels[i]));
+}
+
+} // anonymous namespace
+
+void
+TileCompressor::compress(const sg_gui::skia_pixel_t* pixels, std::size_t size, data_type& data) {
+
+	data.clear();
+
+	// begin of the current sequence of literals
+	std::size_t literalBegin = 0;
+
+	std::size_t i = 0;
+	while (i < size) {
+
+		boost::uint32_t value = toWord(pixels[i]);
+
+		// find the end of the run starting at i
+		std::size_t j = i + 1;
+		while (j < size && toWord(pixels[j]) == value)
+			j++;
+
+		if (j - i >= MinRunLength) {
+
+			flushLiterals(pixels, literalBegin, i, data, LiteralFlag);
+
+			data.push_back(static_cast<boost::uint32_t>(j - i));
+			data.push_back(value);
+
+			literalBegin = j;
+		}
+
+		i = j;
+	}
+
+	flushLiterals(pixels, literalBegin, size, data, LiteralFlag);
+}
+
+bool
+TileCompressor::decompress(const data_type& data, sg_gui::skia_pixel_t* pixels, std::size_t size) {
+
+	std::size_t pixel = 0;
+	std::size_t word  = 0;
+
+	while (word < data.size()) {
+
+		boost::uint32_t header = data[word++];
+		std::size_t     length = header & ~LiteralFlag;
+
+		if (pixel + length > size)
+			return false;
+
+		if (header & LiteralFlag) {
+
+			if (word + length > data.size())
+				return false;
+
+			std::memcpy(static_cast<void*>(pixels + pixel), &data[word], length*sizeof(boost::uint32_t));
+			word += length;
+
+		} else {
+
+			if (word >= data.size())
+				return false;
+
+			sg_gui::skia_pixel_t value;
+			std::memcpy(static_cast<void*>(&value), &data[word++], sizeof(value));
+
+			std::fill(pixels + pixel, pixels + pixel + length, value);
+		}
+
+		pixel += length;
+	}
+
+	return pixel == size;
+}
+
@@ -0,0 +1,46 @@
+#ifndef YANTA_GUI_TILE_COMPRESSOR_H__
+#define YANTA_GUI_TILE_COMPRESSOR_H__
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include <sg_gui/Skia.h>
+
+/**
+ * Run-length coding of tile pixels. Tiles show ink on paper, i.e., they
+ * consist mostly of long runs of the same color, interrupted by short
+ * sequences of anti-aliased stroke pixels. The encoding is a sequence of
+ * words, each starting with a header word. If the highest bit of the header
+ * is set, the remaining bits give the number of literal pixels that follow.
+ * Otherwise, the header is the length of a run, followed by the pixel value
+ * to repeat.
+ */
+class TileCompressor {
+
+public:
+
+	typedef std::vector<boost::uint32_t> data_type;
+
+	/**
+	 * Compress the given pixels into data. The previous content of data is
+	 * replaced.
+	 */
+	static void compress(const sg_gui::skia_pixel_t* pixels, std::size_t size, data_type& data);
+
+	/**
+	 * Decompress data into the given pixels. Returns false, if the data does
+	 * not describe exactly size pixels.
+	 */
+	static bool decompress(const data_type& data, sg_gui::skia_pixel_t* pixels, std::size_t size);
+
+private:
+
+	// flag in the header word to indicate a literal sequence
+	static const boost::uint32_t LiteralFlag = 0x80000000;
+
+	// runs shorter than that are stored as literals
+	static const std::size_t MinRunLength = 3;
+};
+
+#endif // YANTA_GUI_TILE_COMPRESSOR_H__
+
@@ -0,0 +1,233 @@
+#include <util/Logger.h>
+#include "TilePool.h"
+
+logger::LogChannel tilepoollog("tilepoollog", "[TilePool] ");
+
+TilePool::TilePool(
+		unsigned int numSlots,
+		unsigned int tileSize,
+		std::size_t  budget,
+		unsigned int minBuffers) :
+	_bufferSize(tileSize*tileSize),
+	_maxBuffers(std::max(
+			static_cast<unsigned int>(budget/(_bufferSize*sizeof(sg_gui::skia_pixel_t))),
+			std::max(minBuffers, 1u))),
+	_slots(numSlots) {
+
+	LOG_DEBUG(tilepoollog)
+			<< "creating tile pool for " << numSlots << " slots with at most "
+			<< _maxBuffers << " buffers (" << (_maxBuffers*_bufferSize*sizeof(sg_gui::skia_pixel_t)/(1024*1024))
+			<< " MB)" << std::endl;
+}
+
+sg_gui::skia_pixel_t*
+TilePool::get(unsigned int slot, bool pin) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	Slot& s = _slots[slot];
+
+	if (s.buffer) {
+
+		_lru.splice(_lru.begin(), _lru, s.lruPosition);
+
+		if (pin)
+			pinBuffer(s.buffer);
+	}
+
+	return s.buffer;
+}
+
+bool
+TilePool::contains(unsigned int slot) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	return _slots[slot].buffer != 0;
+}
+
+sg_gui::skia_pixel_t*
+TilePool::acquire(unsigned int slot, bool pin) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	Slot& s = _slots[slot];
+
+	if (s.buffer) {
+
+		_lru.splice(_lru.begin(), _lru, s.lruPosition);
+
+	} else {
+
+		s.buffer = getFreeBuffer();
+		_lru.push_front(slot);
+		s.lruPosition = _lru.begin();
+	}
+
+	if (pin)
+		pinBuffer(s.buffer);
+
+	return s.buffer;
+}
+
+sg_gui::skia_pixel_t*
+TilePool::acquireScratch() {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	sg_gui::skia_pixel_t* buffer = getFreeBuffer();
+	pinBuffer(buffer);
+
+	return buffer;
+}
+
+void
+TilePool::replace(unsigned int slot, sg_gui::skia_pixel_t* buffer) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	Slot& s = _slots[slot];
+
+	if (s.buffer) {
+
+		freeBuffer(s.buffer);
+		_lru.splice(_lru.begin(), _lru, s.lruPosition);
+
+	} else {
+
+		_lru.push_front(slot);
+		s.lruPosition = _lru.begin();
+	}
+
+	s.buffer = buffer;
+
+	// the buffer belongs to the slot now, it doesn't need the pin of 
+	// acquireScratch() anymore
+	std::map<const sg_gui::skia_pixel_t*, unsigned int>::iterator pins = _pins.find(buffer);
+	if (pins != _pins.end() && --pins->second == 0)
+		_pins.erase(pins);
+}
+
+void
+TilePool::releaseScratch(sg_gui::skia_pixel_t* buffer) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	// scratch buffers are pinned only by their user
+	_pins.erase(buffer);
+	freeBuffer(buffer);
+}
+
+void
+TilePool::unpin(const sg_gui::skia_pixel_t* buffer) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	std::map<const sg_gui::skia_pixel_t*, unsigned int>::iterator pins = _pins.find(buffer);
+
+	if (pins == _pins.end() || --pins->second > 0)
+		return;
+
+	_pins.erase(pins);
+
+	// the buffer was given back while it was pinned
+	if (_freeWhenUnpinned.erase(buffer))
+		_freeBuffers.push_back(const_cast<sg_gui::skia_pixel_t*>(buffer));
+}
+
+void
+TilePool::release(unsigned int slot) {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	Slot& s = _slots[slot];
+
+	if (!s.buffer)
+		return;
+
+	freeBuffer(s.buffer);
+	_lru.erase(s.lruPosition);
+	s.buffer = 0;
+}
+
+void
+TilePool::releaseAll() {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	for (lru_type::iterator i = _lru.begin(); i != _lru.end(); i++) {
+
+		freeBuffer(_slots[*i].buffer);
+		_slots[*i].buffer = 0;
+	}
+
+	_lru.clear();
+}
+
+sg_gui::skia_pixel_t*
+TilePool::getFreeBuffer() {
+
+	if (!_freeBuffers.empty()) {
+
+		sg_gui::skia_pixel_t* buffer = _freeBuffers.back();
+		_freeBuffers.pop_back();
+
+		return buffer;
+	}
+
+	// the least recently used slot whose buffer is not pinned
+	lru_type::iterator victim = _lru.end();
+	if (_buffers.size() >= _maxBuffers)
+		for (lru_type::iterator i = _lru.end(); i != _lru.begin();) {
+
+			i--;
+
+			if (!_pins.count(_slots[*i].buffer)) {
+
+				victim = i;
+				break;
+			}
+		}
+
+	// Allocate a new buffer if the budget allows for it, or if all buffers are 
+	// pinned. The latter can only exceed the budget by the number of threads 
+	// using the pool.
+	if (victim == _lru.end()) {
+
+		LOG_ALL(tilepoollog) << "allocating buffer " << _buffers.size() << std::endl;
+
+		_buffers.push_back(std::unique_ptr<sg_gui::skia_pixel_t[]>(new sg_gui::skia_pixel_t[_bufferSize]));
+		return _buffers.back().get();
+	}
+
+	// the budget is exhausted, take the buffer of the least recently used slot
+
+	unsigned int evicted = *victim;
+	_lru.erase(victim);
+
+	LOG_ALL(tilepoollog) << "evicting slot " << evicted << std::endl;
+
+	sg_gui::skia_pixel_t* buffer = _slots[evicted].buffer;
+	_slots[evicted].buffer = 0;
+
+	if (_evictionCallback)
+		_evictionCallback(evicted, buffer);
+
+	return buffer;
+}
+
+void
+TilePool::freeBuffer(sg_gui::skia_pixel_t* buffer) {
+
+	if (_pins.count(buffer))
+		_freeWhenUnpinned.insert(buffer);
+	else
+		_freeBuffers.push_back(buffer);
+}
+
+void
+TilePool::pinBuffer(sg_gui::skia_pixel_t* buffer) {
+
+	_pins[buffer]++;
+}
+
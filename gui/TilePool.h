@@ -0,0 +1,191 @@
+#ifndef YANTA_GUI_TILE_POOL_H__
+#define YANTA_GUI_TILE_POOL_H__
+
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <sg_gui/Skia.h>
+
+/**
+ * Provides the pixel buffers for the tiles of a TilesCache. Buffers are handed
+ * out on demand to slots (the physical tiles of the cache), such that tiles
+ * that were never rendered don't use any pixel memory. The total number of
+ * buffers is limited by a memory budget. If the budget is exhausted, the
+ * buffer of the least recently used slot is taken away and reused.
+ *
+ * Buffers that are read or written outside of the pool have to be pinned for
+ * as long as they are used. Pinned buffers are never evicted or reused, even
+ * if their slot gives them back in the meantime.
+ */
+class TilePool {
+
+public:
+
+	/**
+	 * Create a new pool.
+	 *
+	 * @param numSlots
+	 *              The number of slots that can request buffers.
+	 * @param tileSize
+	 *              The width and height of a tile in pixels.
+	 * @param budget
+	 *              The maximal amount of pixel memory in bytes.
+	 * @param minBuffers
+	 *              The minimal number of buffers the pool provides, even if
+	 *              this exceeds the budget.
+	 */
+	TilePool(
+			unsigned int numSlots,
+			unsigned int tileSize,
+			std::size_t  budget,
+			unsigned int minBuffers = 0);
+
+	/**
+	 * Get the buffer of a slot and mark the slot as most recently used. Returns
+	 * 0, if the slot does not have a buffer. If pin is set, the returned buffer
+	 * is pinned and has to be given to unpin() after use.
+	 */
+	sg_gui::skia_pixel_t* get(unsigned int slot, bool pin = false);
+
+	/**
+	 * Check whether a slot has a buffer, without marking it as used.
+	 */
+	bool contains(unsigned int slot);
+
+	/**
+	 * Get the buffer of a slot and mark the slot as most recently used. If the
+	 * slot does not have a buffer, yet, a new one is assigned to it. This might
+	 * evict the buffer of the least recently used slot, in which case the
+	 * eviction callback is invoked for this slot. If pin is set, the returned
+	 * buffer is pinned and has to be given to unpin() after use.
+	 */
+	sg_gui::skia_pixel_t* acquire(unsigned int slot, bool pin = false);
+
+	/**
+	 * Get a pinned buffer that does not belong to any slot, to prepare the
+	 * content of a slot without touching its current buffer. The buffer has to
+	 * be given to replace() or releaseScratch() after use.
+	 */
+	sg_gui::skia_pixel_t* acquireScratch();
+
+	/**
+	 * Make a pinned buffer from acquireScratch() the buffer of a slot, and
+	 * unpin it. The previous buffer of the slot (if any) is given back to the
+	 * pool, as soon as it is not pinned anymore.
+	 */
+	void replace(unsigned int slot, sg_gui::skia_pixel_t* buffer);
+
+	/**
+	 * Give a buffer from acquireScratch() back to the pool without using it.
+	 */
+	void releaseScratch(sg_gui::skia_pixel_t* buffer);
+
+	/**
+	 * Release a pin on a buffer. Buffers that were not pinned by this pool are
+	 * ignored.
+	 */
+	void unpin(const sg_gui::skia_pixel_t* buffer);
+
+	/**
+	 * Give the buffer of a slot back to the pool.
+	 */
+	void release(unsigned int slot);
+
+	/**
+	 * Give the buffers of all slots back to the pool. The memory is kept for
+	 * subsequent calls to acquire().
+	 */
+	void releaseAll();
+
+	/**
+	 * Register a callback to call whenever the buffer of a slot was evicted.
+	 * The callback receives the slot and its buffer, which still holds the
+	 * content of the slot. The callback is invoked while the pool is locked, it
+	 * must not call back into the pool.
+	 */
+	void setEvictionCallback(boost::function<void(unsigned int, const sg_gui::skia_pixel_t*)> callback) {
+
+		_evictionCallback = callback;
+	}
+
+	/**
+	 * Get the maximal number of buffers this pool will allocate.
+	 */
+	unsigned int getMaxBuffers() const { return _maxBuffers; }
+
+	/**
+	 * Get the number of buffers that have been allocated so far.
+	 */
+	unsigned int getNumAllocated() const { return _buffers.size(); }
+
+private:
+
+	typedef std::list<unsigned int> lru_type;
+
+	struct Slot {
+
+		Slot() : buffer(0) {}
+
+		// the buffer assigned to this slot, 0 if none
+		sg_gui::skia_pixel_t* buffer;
+
+		// the position of this slot in the LRU list (valid only if buffer != 0)
+		lru_type::iterator lruPosition;
+	};
+
+	/**
+	 * Get a buffer that is not used by any slot. Evicts the least recently used
+	 * slot without a pinned buffer, if needed.
+	 */
+	sg_gui::skia_pixel_t* getFreeBuffer();
+
+	/**
+	 * Give a buffer that is not used by any slot back to the pool. Pinned
+	 * buffers become free once they are unpinned.
+	 */
+	void freeBuffer(sg_gui::skia_pixel_t* buffer);
+
+	/**
+	 * Add a pin to a buffer.
+	 */
+	void pinBuffer(sg_gui::skia_pixel_t* buffer);
+
+	// the number of pixels in a buffer
+	std::size_t _bufferSize;
+
+	// the maximal number of buffers to allocate
+	unsigned int _maxBuffers;
+
+	// the slots
+	std::vector<Slot> _slots;
+
+	// slots with a buffer, most recently used first
+	lru_type _lru;
+
+	// all the buffers allocated so far
+	std::vector<std::unique_ptr<sg_gui::skia_pixel_t[]>> _buffers;
+
+	// allocated buffers that are not used by any slot
+	std::vector<sg_gui::skia_pixel_t*> _freeBuffers;
+
+	// the number of pins of each pinned buffer
+	std::map<const sg_gui::skia_pixel_t*, unsigned int> _pins;
+
+	// buffers that are not used by any slot anymore, but still pinned
+	std::set<const sg_gui::skia_pixel_t*> _freeWhenUnpinned;
+
+	// callback to invoke when a slot lost its buffer
+	boost::function<void(unsigned int, const sg_gui::skia_pixel_t*)> _evictionCallback;
+
+	// protects all of the above against concurrent access
+	boost::mutex _mutex;
+};
+
+#endif // YANTA_GUI_TILE_POOL_H__
+
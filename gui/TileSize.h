@@ -0,0 +1,10 @@
+#ifndef YANTA_GUI_TILE_SIZE_H__
+#define YANTA_GUI_TILE_SIZE_H__
+
+// the size of the tiles in pixels, set by the CMake option TILE_SIZE
+#ifndef YANTA_TILE_SIZE
+#define YANTA_TILE_SIZE 128
+#endif
+
+#endif // YANTA_GUI_TILE_SIZE_H__
+
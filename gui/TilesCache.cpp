@@ -1,30 +1,76 @@
+#include <cstdlib>
+
 #include <boost/timer/timer.hpp>
 
 #include <SkCanvas.h>
 #include <SkBitmap.h>
 
 #include <util/Logger.h>
+#include <util/ProgramOptions.h>
 #include "TilesCache.h"
 
 logger::LogChannel tilescachelog("tilescachelog", "[TilesCache] ");
 
-TilesCache::TilesCache(const util::point<int,2>& center) :
-	_tiles(boost::extents[Width][Height][TileSize*TileSize]),
-	_tileStates(boost::extents[Width][Height]),
-	_tileChanged(boost::extents[Width][Height]),
+util::ProgramOption optionTilesCacheBudget(
+		util::_long_name        = "tilesCacheBudget",
+		util::_description_text = "The maximal amount of memory (in MB) to use for the pixels of cached tiles.",
+		util::_default_value    = 64);
+
+util::ProgramOption optionTilesCacheColdBudget(
+		util::_long_name        = "tilesCacheColdBudget",
+		util::_description_text = "The maximal amount of memory (in MB) to use for compressed copies of tiles that are not in use.",
+		util::_default_value    = 32);
+
+template <unsigned int Size>
+BasicTilesCache<Size>::BasicTilesCache(
+		unsigned int width,
+		unsigned int height,
+		unsigned int minTilesInMemory,
+		const util::point<int,2>& center) :
+	_width(width),
+	_height(height),
+	_pool(
+			width*height,
+			TileSize,
+			optionTilesCacheBudget.as<std::size_t>()*1024*1024,
+			minTilesInMemory),
+	_coldTiles(
+			width*height,
+			TileSize,
+			optionTilesCacheColdBudget.as<std::size_t>()*1024*1024),
+	_maxCleanUpRadius(0),
+	_uniformTiles(boost::extents[width][height]),
+	_dirtyRegions(boost::extents[width][height]),
+	_incrementalStates(boost::extents[width][height]),
+	_tileStates(width*height),
+	_tileQualities(boost::extents[width][height]),
+	_deferredTiles(boost::extents[width][height]),
+	_changedTiles(width*height),
+	_mapping(width, height),
+	_haveDirtyTiles(false),
 	_backgroundRasterizerStopped(false),
-	_backgroundThread(boost::bind(&TilesCache::cleanUp, this)) {
+	_backgroundThread(boost::bind(&BasicTilesCache::cleanUp, this)) {
+
+	LOG_ALL(tilescachelog) << "creating new " << width << "x" << height << " tiles cache around tile " << center << std::endl;
 
-	LOG_ALL(tilescachelog) << "creating new tiles cache around tile " << center << std::endl;
+	// Don't let the background thread clean more tiles than fit into the pool, 
+	// otherwise it would evict the tiles it just cleaned. The background thread 
+	// visits tiles in squares of side length 2*radius + 1 around the center.
+	while (
+			_maxCleanUpRadius + 1 < static_cast<int>(std::max(_width, _height))/2 &&
+			(2*_maxCleanUpRadius + 3)*(2*_maxCleanUpRadius + 3) <= static_cast<int>(_pool.getMaxBuffers()))
+		_maxCleanUpRadius++;
 
-	for (unsigned int x = 0; x < Width; x++)
-		for (unsigned int y = 0; y < Height; y++)
-			_tileChanged[x][y] = false;
+	LOG_DEBUG(tilescachelog) << "background thread will keep tiles clean up to a radius of " << _maxCleanUpRadius << std::endl;
+
+	_pool.setEvictionCallback(boost::bind(&BasicTilesCache::onSlotEvicted, this, _1, _2));
+	_coldTiles.setDropCallback(boost::bind(&BasicTilesCache::onColdTileDropped, this, _1));
 
 	reset(center);
 }
 
-TilesCache::~TilesCache() {
+template <unsigned int Size>
+BasicTilesCache<Size>::~BasicTilesCache() {
 
 	LOG_ALL(tilescachelog) << "tearing background thread down..." << std::endl;
 
@@ -36,26 +82,42 @@ TilesCache::~TilesCache() {
 	LOG_ALL(tilescachelog) << "background thread stopped" << std::endl;
 }
 
+template <unsigned int Size>
 void
-TilesCache::reset(const util::point<int,2>& center) {
+BasicTilesCache<Size>::reset(const util::point<int,2>& center) {
 
 	_mappingVersionTag.lock();
 
 	// reset the tile mapping, such that all tiles around center map to 
 	// [0,w)x[0,h)
-	_mapping.reset(center - util::point<int,2>(Width/2, Height/2));
+	_mapping.reset(center - util::point<int,2>(_width/2, _height/2));
 
 	_mappingVersionTag.unlock();
 
+	// none of the current content is needed anymore, keep the memory for the 
+	// next tiles
+	_pool.releaseAll();
+	_coldTiles.dropAll();
+
+	for (unsigned int x = 0; x < _width; x++)
+		for (unsigned int y = 0; y < _height; y++)
+			std::atomic_store(&_uniformTiles[x][y], std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>());
+
+	{
+		boost::lock_guard<boost::mutex> lock(_uniformBuffersMutex);
+		_uniformBuffers.clear();
+	}
+
 	// TODO:
 	// • this doesn't need to follow a spiral anymore
-	for (unsigned int x = 0; x < Width; x++)
-		for (unsigned int y = 0; y < Height; y++)
+	for (unsigned int x = 0; x < _width; x++)
+		for (unsigned int y = 0; y < _height; y++)
 			markDirtyPhysical(util::point<int,2>(x, y), Invalid);
 }
 
+template <unsigned int Size>
 void
-TilesCache::shift(const util::point<int,2>& shift) {
+BasicTilesCache<Size>::shift(const util::point<int,2>& shift) {
 
 	LOG_ALL(tilescachelog) << "shifting cache content by " << shift << " tiles" << std::endl;
 
@@ -131,8 +193,9 @@ TilesCache::shift(const util::point<int,2>& shift) {
 	LOG_ALL(tilescachelog) << "cache region is now " << _mapping.get_region() << std::endl;
 }
 
+template <unsigned int Size>
 void
-TilesCache::markDirty(const util::point<int,2>& tile, TileState state) {
+BasicTilesCache<Size>::markDirty(const util::point<int,2>& tile, TileState state) {
 
 	LOG_ALL(tilescachelog) << "marking tile " << tile << " as " << (state == NeedsUpdate ? "needs update" : "needs redraw") << std::endl;;
 
@@ -147,42 +210,150 @@ TilesCache::markDirty(const util::point<int,2>& tile, TileState state) {
 	markDirtyPhysical(physicalTile, state);
 }
 
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::markDirty(const util::point<int,2>& tile, TileState state, const util::box<int,2>& region) {
+
+	LOG_ALL(tilescachelog) << "marking region " << region << " of tile " << tile << " as " << (state == NeedsUpdate ? "needs update" : "needs redraw") << std::endl;;
+
+	if (!_mapping.get_region().contains(tile)) {
+
+		LOG_ALL(tilescachelog) << " -- this tile is not in the cache" << std::endl;
+		return;
+	}
+
+	util::point<int,2> physicalTile = _mapping.map(tile);
+
+	// the region relative to the tile
+	util::box<int,2> tileRegion = region - tile*static_cast<int>(TileSize);
+
+	markDirtyPhysical(physicalTile, state, tileRegion);
+}
+
+template <unsigned int Size>
 void
-TilesCache::markDirtyPhysical(const util::point<int,2>& physicalTile, TileState state) {
+BasicTilesCache<Size>::markDirtyPhysical(const util::point<int,2>& physicalTile, TileState state) {
+
+	markDirtyPhysical(physicalTile, state, util::box<int,2>(0, 0, TileSize, TileSize));
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::markDirtyPhysical(const util::point<int,2>& physicalTile, TileState state, const util::box<int,2>& region) {
 
 	// without a background clean-up thread, allow no invalid flags
 	if (!_backgroundRasterizer && state == Invalid)
 		state = NeedsRedraw;
 
+	{
+		boost::lock_guard<boost::mutex> lock(_dirtyRegionsMutex);
+
+		util::box<int,2>& dirtyRegion = _dirtyRegions[physicalTile.x()][physicalTile.y()];
+
+		// invalid tiles have to be drawn completely
+		util::box<int,2> tileRegion(0, 0, TileSize, TileSize);
+		util::box<int,2> newRegion = (state == Invalid ? tileRegion : tileRegion.intersection(region));
+
+		if (dirtyRegion.area() <= 0) {
+
+			dirtyRegion = newRegion;
+
+		} else if (newRegion.area() > 0) {
+
+			dirtyRegion.min().x() = std::min(dirtyRegion.min().x(), newRegion.min().x());
+			dirtyRegion.min().y() = std::min(dirtyRegion.min().y(), newRegion.min().y());
+			dirtyRegion.max().x() = std::max(dirtyRegion.max().x(), newRegion.max().x());
+			dirtyRegion.max().y() = std::max(dirtyRegion.max().y(), newRegion.max().y());
+		}
+	}
+
 	// set the flag, but make sure we are not overwriting previous dirty flags 
 	// of higher precedence
-	_tileStates[physicalTile.x()][physicalTile.y()] = std::max(_tileStates[physicalTile.x()][physicalTile.y()], state);
+	raiseTileState(getSlot(physicalTile), state);
 
-	if (_backgroundRasterizer) {
+	// a compressed copy is only useful as a base for incremental updates
+	if (state >= NeedsRedraw)
+		_coldTiles.drop(getSlot(physicalTile));
 
-		{
-			boost::lock_guard<boost::mutex> lock(_haveDirtyTilesMutex);
-			_haveDirtyTiles = true;
-		}
+	if (_backgroundRasterizer)
+		notifyBackgroundRasterizer();
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::raiseTileState(unsigned int slot, TileState state) {
+
+	std::atomic<TileState>& tileState = _tileStates[slot];
+
+	// the state might be changed by others in the meantime, retry until it 
+	// is at least state
+	TileState current = tileState.load();
+	while (current < state && !tileState.compare_exchange_weak(current, state)) {}
+}
 
-		_wakeupBackgroundRasterizer.notify_one();
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::upgradeTiles() {
+
+	if (_backgroundRasterizer)
+		notifyBackgroundRasterizer();
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::notifyBackgroundRasterizer() {
+
+	{
+		boost::lock_guard<boost::mutex> lock(_haveDirtyTilesMutex);
+		_haveDirtyTiles = true;
 	}
+
+	_wakeupBackgroundRasterizer.notify_one();
 }
 
+template <unsigned int Size>
 sg_gui::skia_pixel_t*
-TilesCache::getTile(const util::point<int,2>& tile, Rasterizer& rasterizer) {
+BasicTilesCache<Size>::getTile(const util::point<int,2>& tile, Rasterizer& rasterizer, bool* uniform, bool mayRasterize) {
 
 	LOG_ALL(tilescachelog) << "getting tile " << tile << std::endl;
 
 	util::point<int,2> physicalTile = _mapping.map(tile);
 
-	//boost::mutex::scoped_lock lock(_tileMutexes[physicalTile.x()][physicalTile.y()]);
-
 	// the tile is not ready, yet
-	if (_tileStates[physicalTile.x()][physicalTile.y()] == Invalid)
+	if (getTileState(physicalTile) == Invalid)
+		return 0;
+
+	bool isUniform = static_cast<bool>(std::atomic_load(&_uniformTiles[physicalTile.x()][physicalTile.y()]));
+
+	// clean tiles and tiles that need an incremental update need their previous 
+	// content
+	if (!isUniform && getTileState(physicalTile) <= NeedsUpdate && !makeResident(getSlot(physicalTile))) {
+
+		LOG_ALL(tilescachelog) << "this tile lost its content" << std::endl;
+
+		markDirtyPhysical(physicalTile, Invalid);
 		return 0;
+	}
+
+	// Leave dirty tiles to the background thread, if we are not supposed to 
+	// rasterize. Once a tile was deferred, only the background thread touches 
+	// it, until it is clean again. Tiles the background thread does not visit 
+	// can not be deferred.
+	if (
+			_backgroundRasterizer &&
+			isInCleanUpRadius(tile) &&
+			getTileState(physicalTile) != Clean &&
+			(!mayRasterize || _deferredTiles[physicalTile.x()][physicalTile.y()])) {
 
-	if (_tileStates[physicalTile.x()][physicalTile.y()] == NeedsUpdate) {
+		LOG_ALL(tilescachelog) << "deferring update of this tile, showing its previous content" << std::endl;
+
+		if (!_deferredTiles[physicalTile.x()][physicalTile.y()]) {
+
+			_deferredTiles[physicalTile.x()][physicalTile.y()] = true;
+			notifyBackgroundRasterizer();
+		}
+
+	} else if (getTileState(physicalTile) == NeedsUpdate) {
 
 		LOG_ALL(tilescachelog) << "this tile needs an update" << std::endl;
 
@@ -191,9 +362,8 @@ TilesCache::getTile(const util::point<int,2>& tile, Rasterizer& rasterizer) {
 		tileRegion *= static_cast<int>(TileSize);
 
 		updateTile(physicalTile, tileRegion, rasterizer);
-	}
 
-	if (_tileStates[physicalTile.x()][physicalTile.y()] == NeedsRedraw) {
+	} else if (getTileState(physicalTile) == NeedsRedraw) {
 
 		LOG_ALL(tilescachelog) << "this tile needs a redraw" << std::endl;
 
@@ -201,58 +371,280 @@ TilesCache::getTile(const util::point<int,2>& tile, Rasterizer& rasterizer) {
 		util::box<int,2> tileRegion(tile.x(), tile.y(), tile.x() + 1, tile.y() + 1);
 		tileRegion *= static_cast<int>(TileSize);
 
-		rasterizer.setIncremental(false);
 		updateTile(physicalTile, tileRegion, rasterizer);
-		rasterizer.setIncremental(true);
 	}
 
-	return &_tiles[physicalTile.x()][physicalTile.y()][0];
-}
+	// The map of shared buffers keeps this one alive until the next reset(), 
+	// so we can safely return a pointer to it.
+	std::shared_ptr<std::vector<sg_gui::skia_pixel_t>> uniformTile = std::atomic_load(&_uniformTiles[physicalTile.x()][physicalTile.y()]);
 
-bool
-TilesCache::wasChanged(const util::point<int,2>& tile) {
+	if (uniform)
+		*uniform = static_cast<bool>(uniformTile);
 
-	util::point<int,2> physicalTile = _mapping.map(tile);
+	if (uniformTile)
+		return &(*uniformTile)[0];
+
+	// the buffer stays pinned until the caller releases it
+	sg_gui::skia_pixel_t* buffer = _pool.get(getSlot(physicalTile), true);
+
+	// the tile lost its memory in the meantime
+	if (buffer == 0) {
+
+		LOG_ALL(tilescachelog) << "this tile was evicted" << std::endl;
+
+		markDirtyPhysical(physicalTile, Invalid);
+	}
 
-	return _tileChanged[physicalTile.x()][physicalTile.y()];
+	return buffer;
 }
 
-void
-TilesCache::seenChange(const util::point<int,2>& tile) {
+template <unsigned int Size>
+bool
+BasicTilesCache<Size>::nextChangedTile(util::point<int,2>& tile) {
 
-	util::point<int,2> physicalTile = _mapping.map(tile);
+	ChangedTile changed;
 
-	_tileChanged[physicalTile.x()][physicalTile.y()] = false;
+	if (!_changedTiles.pop(changed))
+		return false;
+
+	tile = util::point<int,2>(changed.x, changed.y);
+
+	return true;
 }
 
+template <unsigned int Size>
 void
-TilesCache::setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer) {
+BasicTilesCache<Size>::setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer) {
 
 	_backgroundRasterizer = rasterizer;
 }
 
+template <unsigned int Size>
 void
-TilesCache::updateTile(const util::point<int,2>& physicalTile, const util::box<int,2>& tileRegion, Rasterizer& rasterizer) {
+BasicTilesCache<Size>::updateTile(const util::point<int,2>& physicalTile, const util::box<int,2>& tileRegion, Rasterizer& rasterizer) {
 
 	LOG_ALL(tilescachelog) << "updating physical tile " << physicalTile << " with content of " << tileRegion << std::endl;
 
+	// Mark it as clean. Whoever makes it dirty again after this point makes 
+	// sure it gets drawn again.
+	TileState state = takeTileState(physicalTile);
+
 	// It can happen that a clean-up request became stale because getTile() 
 	// cleaned the tile already. In this case, there is nothing to do here.
-	if (_tileStates[physicalTile.x()][physicalTile.y()] == Clean) {
+	if (state == Clean) {
 
 		LOG_ALL(tilescachelog) << "this tile is clean already -- skip update" << std::endl;
 		return;
 	}
 
-	// Possible data race:
-	// 
-	// Tile get's cleaned by someone else while we are here.
+	// only tiles that need an update can be drawn incrementally
+	bool incremental = (state == NeedsUpdate);
+
+	_deferredTiles[physicalTile.x()][physicalTile.y()] = false;
+
+	// the part of the tile that needs to be drawn
+	util::box<int,2> dirtyRegion = takeDirtyRegion(physicalTile);
+
+	unsigned int slot = getSlot(physicalTile);
+	std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>& uniformTile = _uniformTiles[physicalTile.x()][physicalTile.y()];
+
+	// tiles without document content don't need a buffer of their own
+	UniformContent content;
+	if (rasterizer.getUniformContent(tileRegion, content)) {
+
+		std::shared_ptr<std::vector<sg_gui::skia_pixel_t>> uniformBuffer = getUniformBuffer(content, tileRegion, rasterizer);
+
+		if (uniformBuffer) {
+
+			LOG_ALL(tilescachelog) << "this tile has no content, using a shared buffer" << std::endl;
+
+			std::atomic_store(&uniformTile, uniformBuffer);
+			_pool.release(slot);
+			_coldTiles.drop(slot);
+
+			// without strokes, all qualities look the same
+			_tileQualities[physicalTile.x()][physicalTile.y()] = rasterizer.getTargetQuality();
+
+			// the shared buffer was not drawn with the memory of this tile
+			_incrementalStates[physicalTile.x()][physicalTile.y()] = IncrementalState();
+
+			return;
+		}
+	}
+
+	// if the tile used a shared buffer so far, its content is the base for 
+	// incremental updates
+	std::shared_ptr<std::vector<sg_gui::skia_pixel_t>> previous =
+			std::atomic_exchange(&uniformTile, std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>());
+
+	// Draw into a scratch buffer, which replaces the buffer of the tile once 
+	// it is done. Other threads might be copying the current buffer in the 
+	// meantime.
+	sg_gui::skia_pixel_t* buffer = _pool.acquireScratch();
+	storeEvictedTiles();
+
+	// otherwise, the content is in the pool or the cold tier (if at all)
+	bool havePreviousContent = (previous || makeResident(slot));
+
+	if (previous) {
+
+		std::copy(previous->begin(), previous->end(), buffer);
+
+	} else if (havePreviousContent) {
+
+		const sg_gui::skia_pixel_t* current = _pool.get(slot, true);
+
+		if (current) {
+
+			std::copy(current, current + TileSize*TileSize, buffer);
+			_pool.unpin(current);
+
+		} else {
+
+			// evicted since makeResident()
+			havePreviousContent = false;
+		}
+	}
+
+	// Without the previous content, the whole tile has to be drawn. Otherwise, 
+	// it is enough to draw the dirty region.
+	util::box<int,2> drawRegion = tileRegion;
+	if (havePreviousContent && dirtyRegion.area() > 0)
+		drawRegion = dirtyRegion + tileRegion.min();
+
+	// Each tile remembers what was drawn into it, such that an incremental 
+	// update adds exactly the new content of the tile. A non-incremental draw 
+	// starts from scratch within drawRegion.
+	IncrementalState& incrementalState = _incrementalStates[physicalTile.x()][physicalTile.y()];
+	bool fromScratch = (!incremental || !havePreviousContent);
+	if (fromScratch)
+		incrementalState = IncrementalState();
+
+	// Tiles without content get the worst quality first, the background 
+	// thread upgrades them once there is nothing more urgent to do. Without a 
+	// background thread, there is no upgrade. Redraws over existing content 
+	// use the target quality, to not lower the quality of the whole tile for 
+	// a small change.
+	Quality targetQuality = rasterizer.getTargetQuality();
+	Quality quality       = (!havePreviousContent && _backgroundRasterizer ? Worst : targetQuality);
+
+	// the tile has the quality of its worst part
+	bool wholeTile = (drawRegion.min() == tileRegion.min() && drawRegion.max() == tileRegion.max());
+	Quality& tileQuality = _tileQualities[physicalTile.x()][physicalTile.y()];
+	tileQuality = (wholeTile ? quality : std::min(tileQuality, quality));
+
+	LOG_ALL(tilescachelog) << "drawing " << drawRegion << (incremental ? " incrementally" : "") << " with quality " << quality << std::endl;
+
+	rasterizer.setIncrementalState(&incrementalState);
+	rasterize(buffer, tileRegion, drawRegion, rasterizer, quality);
+	rasterizer.setIncrementalState(0);
+
+	_pool.replace(slot, buffer);
+
+	if (quality < targetQuality)
+		notifyBackgroundRasterizer();
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::upgradeTile(const util::point<int,2>& physicalTile, const util::box<int,2>& tileRegion, Rasterizer& rasterizer) {
+
+	// tiles that became dirty in the meantime will be drawn anyway
+	if (getTileState(physicalTile) != Clean)
+		return;
+
+	unsigned int slot = getSlot(physicalTile);
+
+	// tiles without memory are drawn again when they are needed
+	if (!_pool.contains(slot))
+		return;
+
+	Quality quality = rasterizer.getTargetQuality();
+
+	LOG_ALL(tilescachelog) << "upgrading physical tile " << physicalTile << " to quality " << quality << std::endl;
+
+	// Draw the whole tile from scratch into a buffer of its own. The current 
+	// buffer might be copied by the upload thread in the meantime, it is 
+	// swapped for the new one when we are done.
+	sg_gui::skia_pixel_t* buffer = _pool.acquireScratch();
+	storeEvictedTiles();
+
+	IncrementalState incrementalState;
+
+	rasterizer.setIncrementalState(&incrementalState);
+	rasterize(buffer, tileRegion, tileRegion, rasterizer, quality);
+	rasterizer.setIncrementalState(0);
+
+	// the tile became dirty or lost its memory while we were drawing, the 
+	// upgrade is outdated
+	if (getTileState(physicalTile) != Clean || !_pool.contains(slot)) {
+
+		_pool.releaseScratch(buffer);
+		return;
+	}
+
+	_pool.replace(slot, buffer);
+
+	_incrementalStates[physicalTile.x()][physicalTile.y()] = incrementalState;
+	_tileQualities[physicalTile.x()][physicalTile.y()]     = quality;
+}
+
+template <unsigned int Size>
+util::box<int,2>
+BasicTilesCache<Size>::takeDirtyRegion(const util::point<int,2>& physicalTile) {
+
+	boost::lock_guard<boost::mutex> lock(_dirtyRegionsMutex);
+
+	util::box<int,2> dirtyRegion = _dirtyRegions[physicalTile.x()][physicalTile.y()];
+	_dirtyRegions[physicalTile.x()][physicalTile.y()] = util::box<int,2>(0, 0, 0, 0);
+
+	return dirtyRegion;
+}
+
+template <unsigned int Size>
+std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>
+BasicTilesCache<Size>::getUniformBuffer(
+		const UniformContent& content,
+		const util::box<int,2>& tileRegion,
+		Rasterizer& rasterizer) {
+
+	{
+		boost::lock_guard<boost::mutex> lock(_uniformBuffersMutex);
+
+		auto i = _uniformBuffers.find(content);
+		if (i != _uniformBuffers.end())
+			return i->second;
+
+		if (_uniformBuffers.size() >= MaxUniformBuffers)
+			return std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>();
+	}
+
+	LOG_DEBUG(tilescachelog) << "creating a new shared buffer for uniform tiles" << std::endl;
+
+	// rasterize without holding the lock, the region is cheap to draw
+	std::shared_ptr<std::vector<sg_gui::skia_pixel_t>> buffer =
+			std::make_shared<std::vector<sg_gui::skia_pixel_t>>(TileSize*TileSize);
 
-	// mark it as clean
-	_tileStates[physicalTile.x()][physicalTile.y()] = Clean;
+	// draw from scratch
+	IncrementalState incrementalState;
+	rasterizer.setIncrementalState(&incrementalState);
+	rasterize(&(*buffer)[0], tileRegion, tileRegion, rasterizer, rasterizer.getTargetQuality());
+	rasterizer.setIncrementalState(0);
+
+	boost::lock_guard<boost::mutex> lock(_uniformBuffersMutex);
+
+	// someone else might have been faster
+	return _uniformBuffers.insert(std::make_pair(content, buffer)).first->second;
+}
 
-	// get the data of the tile
-	sg_gui::skia_pixel_t* buffer = &_tiles[physicalTile.x()][physicalTile.y()][0];
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::rasterize(
+		sg_gui::skia_pixel_t* buffer,
+		const util::box<int,2>& tileRegion,
+		const util::box<int,2>& drawRegion,
+		Rasterizer& rasterizer,
+		Quality quality) {
 
 	// wrap the buffer in a skia bitmap
 	SkBitmap bitmap;
@@ -270,11 +662,18 @@ TilesCache::updateTile(const util::point<int,2>& physicalTile, const util::box<i
 	util::point<int,2> translate = -tileRegion.min();
 	canvas.translate(translate.x(), translate.y());
 
-	rasterizer.draw(canvas, tileRegion);
+	boost::timer::cpu_timer timer;
+
+	rasterizer.draw(canvas, drawRegion, quality);
+
+	// only whole tiles are comparable
+	if (_qualityGovernor && drawRegion.min() == tileRegion.min() && drawRegion.max() == tileRegion.max())
+		_qualityGovernor->addTileTime(quality, timer.elapsed().wall*1e-9);
 }
 
+template <unsigned int Size>
 void
-TilesCache::cleanUp() {
+BasicTilesCache<Size>::cleanUp() {
 
 	LOG_ALL(tilescachelog) << "background clean-up thread started" << std::endl;
 
@@ -321,11 +720,12 @@ TilesCache::cleanUp() {
 	}
 }
 
+template <unsigned int Size>
 bool
-TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion) {
+BasicTilesCache<Size>::findTile(version_tag::version_type& mappingVersion, util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion, TileProbe probe) {
 
 	// for every radius around center
-	for (int radius = 0; radius < std::max((int)Width, (int)Height)/2; radius++) {
+	for (int radius = 0; radius <= _maxCleanUpRadius; radius++) {
 
 		mappingVersion = _mappingVersionTag.get_version();
 
@@ -345,7 +745,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x() = center.x() - x;
 			tile.y() = center.y() - radius;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if ((this->*probe)(tile, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -355,7 +755,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x() = center.x() - radius;
 			tile.y() = center.y() + y;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if ((this->*probe)(tile, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -365,7 +765,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x() = center.x() + x;
 			tile.y() = center.y() + radius;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if ((this->*probe)(tile, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -375,7 +775,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x() = center.x() + radius;
 			tile.y() = center.y() - y;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if ((this->*probe)(tile, physicalTile, tileRegion))
 				return true;
 		}
 	}
@@ -383,8 +783,9 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 	return false;
 }
 
+template <unsigned int Size>
 unsigned int
-TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
+BasicTilesCache<Size>::cleanDirtyTiles(unsigned int  maxNumRequests) {
 
 	unsigned int cleaned = 0;
 
@@ -396,20 +797,37 @@ TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
 		util::point<int,2> physicalTile;
 		util::box<int,2>  tileRegion(0, 0, 0, 0);
 
-		if (!findInvalidTile(mappingVersion, tile, physicalTile, tileRegion))
-			return cleaned;
+		// invalid tiles first, then tiles getTile() deferred to us, upgrades 
+		// only if there is nothing else to do
+		bool upgrade = false;
+		if (
+				!findTile(mappingVersion, tile, physicalTile, tileRegion, &BasicTilesCache::isInvalid) &&
+				!findTile(mappingVersion, tile, physicalTile, tileRegion, &BasicTilesCache::isDeferred)) {
+
+			if (!findTile(mappingVersion, tile, physicalTile, tileRegion, &BasicTilesCache::needsUpgrade))
+				return cleaned;
+
+			upgrade = true;
+		}
 
 		// the mapping changed while we were computing the physical tile and 
 		// region
 		if (_mappingVersionTag.changed(mappingVersion))
 			return cleaned;
 
-		LOG_DEBUG(tilescachelog) << "cleaning physical tile " << physicalTile << std::endl;
+		LOG_DEBUG(tilescachelog) << (upgrade ? "upgrading" : "cleaning") << " physical tile " << physicalTile << std::endl;
 
 		// update it
-		updateTile(physicalTile, tileRegion, *_backgroundRasterizer);
+		if (upgrade)
+			upgradeTile(physicalTile, tileRegion, *_backgroundRasterizer);
+		else
+			updateTile(physicalTile, tileRegion, *_backgroundRasterizer);
 
-		_tileChanged[physicalTile.x()][physicalTile.y()] = true;
+		// publish the change
+		ChangedTile changed;
+		changed.x = tile.x();
+		changed.y = tile.y();
+		_changedTiles.push(changed);
 
 		// inform ohers
 		if (_tileChangedCallback) {
@@ -422,15 +840,129 @@ TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
 	return cleaned;
 }
 
+template <unsigned int Size>
+bool
+BasicTilesCache<Size>::makeResident(unsigned int slot) {
+
+	if (_pool.get(slot))
+		return true;
+
+	// the tile might just have been evicted
+	storeEvictedTiles();
+
+	if (!_coldTiles.contains(slot))
+		return false;
+
+	LOG_ALL(tilescachelog) << "restoring slot " << slot << " from the cold tier" << std::endl;
+
+	sg_gui::skia_pixel_t* buffer = _pool.acquire(slot, true);
+	storeEvictedTiles();
+
+	bool restored = _coldTiles.restore(slot, buffer);
+	_pool.unpin(buffer);
+
+	return restored;
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::onSlotEvicted(unsigned int slot, const sg_gui::skia_pixel_t* buffer) {
+
+	LOG_ALL(tilescachelog) << "physical tile " << util::point<int,2>(slot/_height, slot%_height) << " lost its memory" << std::endl;
+
+	// keep the content of tiles that are still valid for the cold tier
+	if (_tileStates[slot].load() > NeedsUpdate) {
+
+		invalidateSlot(slot);
+		return;
+	}
+
+	boost::lock_guard<boost::mutex> lock(_evictedTilesMutex);
+
+	_evictedTiles.push_back(EvictedTile());
+	EvictedTile& evicted = _evictedTiles.back();
+	evicted.slot = slot;
+
+	if (!_spareEvictionBuffers.empty()) {
+
+		evicted.content.swap(_spareEvictionBuffers.back());
+		_spareEvictionBuffers.pop_back();
+	}
+
+	// only copy here, the compression happens outside of the pool lock
+	evicted.content.assign(buffer, buffer + TileSize*TileSize);
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::storeEvictedTiles() {
+
+	boost::lock_guard<boost::mutex> storeLock(_storeEvictedTilesMutex);
+
+	std::vector<EvictedTile> evictedTiles;
+
+	{
+		boost::lock_guard<boost::mutex> lock(_evictedTilesMutex);
+		evictedTiles.swap(_evictedTiles);
+	}
+
+	if (evictedTiles.empty())
+		return;
+
+	LOG_ALL(tilescachelog) << "storing " << evictedTiles.size() << " evicted tiles in the cold tier" << std::endl;
+
+	for (unsigned int i = 0; i < evictedTiles.size(); i++) {
+
+		unsigned int slot = evictedTiles[i].slot;
+
+		// tiles that got dirty since they were evicted are not worth keeping
+		if (_tileStates[slot].load() <= NeedsUpdate)
+			_coldTiles.store(slot, &evictedTiles[i].content[0]);
+		else
+			invalidateSlot(slot);
+	}
+
+	boost::lock_guard<boost::mutex> lock(_evictedTilesMutex);
+
+	for (unsigned int i = 0; i < evictedTiles.size(); i++) {
+
+		_spareEvictionBuffers.push_back(std::vector<sg_gui::skia_pixel_t>());
+		_spareEvictionBuffers.back().swap(evictedTiles[i].content);
+	}
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::onColdTileDropped(unsigned int slot) {
+
+	LOG_ALL(tilescachelog) << "physical tile " << util::point<int,2>(slot/_height, slot%_height) << " was dropped from the cold tier" << std::endl;
+
+	invalidateSlot(slot);
+}
+
+template <unsigned int Size>
+void
+BasicTilesCache<Size>::invalidateSlot(unsigned int slot) {
+
+	// The content of this tile is gone. We don't use markDirtyPhysical() here, 
+	// since we don't want to wake up the background thread for a tile that was 
+	// evicted for not being used.
+	raiseTileState(slot, _backgroundRasterizer ? Invalid : NeedsRedraw);
+
+	boost::lock_guard<boost::mutex> lock(_dirtyRegionsMutex);
+	_dirtyRegions[slot/_height][slot%_height] = util::box<int,2>(0, 0, TileSize, TileSize);
+}
+
+template <unsigned int Size>
 bool
-TilesCache::isInvalid(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion) {
+BasicTilesCache<Size>::isInvalid(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion) {
 
 	// get physical tile
 	physicalTile = _mapping.map(tile);
 
 	LOG_ALL(tilescachelog) << "probing tile " << tile << std::endl;
 
-	if (_tileStates[physicalTile.x()][physicalTile.y()] == Invalid) {
+	if (getTileState(physicalTile) == Invalid) {
 
 		LOG_ALL(tilescachelog) << "tile " << tile << " is invalid" << std::endl;
 
@@ -444,3 +976,55 @@ TilesCache::isInvalid(const util::point<int,2>& tile, util::point<int,2>& physic
 	return false;
 }
 
+template <unsigned int Size>
+bool
+BasicTilesCache<Size>::isInCleanUpRadius(const util::point<int,2>& tile) {
+
+	util::point<int,2> offset = tile - _mapping.get_region().center();
+
+	return std::max(std::abs(offset.x()), std::abs(offset.y())) <= _maxCleanUpRadius;
+}
+
+template <unsigned int Size>
+bool
+BasicTilesCache<Size>::isDeferred(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion) {
+
+	physicalTile = _mapping.map(tile);
+
+	if (!_deferredTiles[physicalTile.x()][physicalTile.y()] || getTileState(physicalTile) == Clean)
+		return false;
+
+	tileRegion = util::box<int,2>(tile.x(), tile.y(), tile.x() + 1, tile.y() + 1);
+	tileRegion *= static_cast<int>(TileSize);
+
+	return true;
+}
+
+template <unsigned int Size>
+bool
+BasicTilesCache<Size>::needsUpgrade(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion) {
+
+	physicalTile = _mapping.map(tile);
+
+	if (getTileState(physicalTile) != Clean)
+		return false;
+
+	if (_tileQualities[physicalTile.x()][physicalTile.y()] >= _backgroundRasterizer->getTargetQuality())
+		return false;
+
+	// tiles without memory are not worth upgrading
+	if (!_pool.contains(getSlot(physicalTile)))
+		return false;
+
+	tileRegion = util::box<int,2>(tile.x(), tile.y(), tile.x() + 1, tile.y() + 1);
+	tileRegion *= static_cast<int>(TileSize);
+
+	return true;
+}
+
+// the tile sizes to choose from with the CMake option TILE_SIZE
+template class BasicTilesCache<64>;
+template class BasicTilesCache<128>;
+template class BasicTilesCache<256>;
+template class BasicTilesCache<512>;
+
@@ -1,6 +1,12 @@
 #ifndef YANTA_GUI_TILES_CACHE_H__
 #define YANTA_GUI_TILES_CACHE_H__
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/lockfree/queue.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/thread.hpp>
 
@@ -8,22 +14,54 @@
 
 #include <util/torus_mapping.hpp>
 #include <util/version_tag.h>
+#include "CompressedTileStore.h"
+#include "QualityGovernor.h"
 #include "Rasterizer.h"
+#include "TilePool.h"
+#include "TileSize.h"
+
+/**
+ * Get the binary logarithm of a power of two.
+ */
+constexpr unsigned int tileSizeLog2(unsigned int size) {
+
+	return (size <= 1 ? 0 : 1 + tileSizeLog2(size/2));
+}
 
 /**
  * Stores tiles (rectangle image buffers) on a torus topology to have them 
- * quickly available for drawing.
+ * quickly available for drawing. The pixel memory of the tiles is taken from a 
+ * TilePool on demand, such that the size of the cache is not limited by the 
+ * memory needed to hold all of its tiles at the same time. Clean tiles that 
+ * lose their memory in the pool are kept compressed in a second, cold tier, 
+ * from which they are restored when they are needed again. Tiles that show no 
+ * document content share a single buffer with all equal tiles.
+ *
+ * If a background rasterizer is set, tiles that are drawn from scratch are 
+ * drawn with the worst quality first, to have them available quickly. Once 
+ * there are no invalid tiles left, the background thread redraws them with 
+ * the quality the rasterizer targets.
+ *
+ * The size of the tiles is a template parameter, such that the arithmetic on 
+ * pixel and tile coordinates can be resolved at compile time. Instances for 
+ * the sizes 64, 128, 256, and 512 are compiled with TilesCache.cpp. TilesCache 
+ * is the instance for YANTA_TILE_SIZE.
  */
-class TilesCache {
+template <unsigned int Size>
+class BasicTilesCache {
 
 public:
 
 	// the size of a tile
-	static const unsigned int TileSize = 128;
+	static const unsigned int TileSize = Size;
 
-	// the number of tiles in the x and y direction
-	static const unsigned int Width  = 64;
-	static const unsigned int Height = 64;
+	// for tiles with a power of two as size, the binary logarithm of the size
+	static const bool         TileSizeIsPowerOfTwo = ((Size & (Size - 1)) == 0);
+	static const unsigned int TileSizeLog2         = tileSizeLog2(Size);
+
+	// the default number of tiles in the x and y direction
+	static const unsigned int DefaultWidth  = 64;
+	static const unsigned int DefaultHeight = 64;
 
 	/**
 	 * The possible state of tiles in the cache.
@@ -46,12 +84,23 @@ public:
 	/**
 	 * Create a new cache with tile 'center' being in the middle.
 	 *
+	 * @param width, height
+	 *              The number of tiles in the x and y direction.
+	 * @param minTilesInMemory
+	 *              The minimal number of tiles to keep in memory. The pixel 
+	 *              memory of the cache is limited by the program option 
+	 *              'tilesCacheBudget', unless this number of tiles does not fit 
+	 *              into the budget.
 	 * @param center
 	 *              The logical coordinates of the center tile.
 	 */
-	TilesCache(const util::point<int,2>& center = util::point<int,2>(0, 0));
+	BasicTilesCache(
+			unsigned int width  = DefaultWidth,
+			unsigned int height = DefaultHeight,
+			unsigned int minTilesInMemory = 0,
+			const util::point<int,2>& center = util::point<int,2>(0, 0));
 
-	~TilesCache();
+	~BasicTilesCache();
 
 	/**
 	 * Reset the cache such that tile 'center' is in the middle. This will mark 
@@ -71,31 +120,71 @@ public:
 	 */
 	void shift(const util::point<int,2>& shift);
 
+	/**
+	 * Get the tile coordinate of a pixel coordinate, i.e., the pixel divided by 
+	 * the tile size, rounded down.
+	 */
+	static inline int getTileCoordinate(int pixel) {
+
+		// a shift rounds down for negative pixels as well
+		if (TileSizeIsPowerOfTwo)
+			return pixel >> TileSizeLog2;
+
+		return (pixel >= 0 ? pixel/static_cast<int>(TileSize) : -((-pixel - 1)/static_cast<int>(TileSize)) - 1);
+	}
+
 	/**
 	 * Mark a tile as dirty.
 	 */
 	void markDirty(const util::point<int,2>& tile, TileState state);
 
+	/**
+	 * Mark only a region of a tile as dirty. Subsequent updates of the tile 
+	 * will only redraw the union of the regions marked dirty since the last 
+	 * update.
+	 *
+	 * @param region
+	 *              The dirty region in pixels.
+	 */
+	void markDirty(const util::point<int,2>& tile, TileState state, const util::box<int,2>& region);
+
 	/**
 	 * Get the data of a tile in the cache. If the tile was marked dirty, it 
 	 * will be updated using the provided rasterizer. The caller has to ensure 
-	 * that the tile is part of the cache.
+	 * that the tile is part of the cache. The returned buffer does not change 
+	 * and is not reused until it is given to releaseTile(), which has to 
+	 * happen right after it was copied.
+	 *
+	 * @param uniform
+	 *              If given, set to true if the returned buffer is shared by 
+	 *              all tiles without document content that look the same. The 
+	 *              content of a shared buffer never changes until the next 
+	 *              reset().
+	 * @param mayRasterize
+	 *              If false and there is a background rasterizer, dirty tiles 
+	 *              are not updated. Instead, their previous content is 
+	 *              returned (if they have any), and the tile is handed to the 
+	 *              background thread, which reports it as changed once it is 
+	 *              clean.
 	 */
-	sg_gui::skia_pixel_t* getTile(const util::point<int,2>& tile, Rasterizer& rasterizer);
+	sg_gui::skia_pixel_t* getTile(const util::point<int,2>& tile, Rasterizer& rasterizer, bool* uniform = 0, bool mayRasterize = true);
 
 	/**
-	 * Ask whether a tile was changed by the cache. If it was changed, the 
-	 * caller has to indicate that the change was observed by calling 
-	 * seenChange().
+	 * Give a buffer returned by getTile() back to the cache.
 	 */
-	bool wasChanged(const util::point<int,2>& tile);
+	void releaseTile(const sg_gui::skia_pixel_t* data) { _pool.unpin(data); }
 
 	/**
-	 * Indicate that the change indicated by wasChanged() was acknowledged by 
-	 * the caller. Call this method before you reload the tile to make sure you 
-	 * don't miss another change.
+	 * Get the next tile that was changed by the cache (i.e., by the background 
+	 * thread). Returns false, if there are no more changes. Changes are 
+	 * published in a lock-free queue, such that polling for changes costs 
+	 * nothing if there are none. The same tile can be reported several times. 
+	 * Only one thread should consume changes.
+	 *
+	 * @param tile
+	 *              The logical coordinates of the changed tile.
 	 */
-	void seenChange(const util::point<int,2>& tile);
+	bool nextChangedTile(util::point<int,2>& tile);
 
 	/**
 	 * Set a background rasterizer for this cache. This will launch a background 
@@ -103,22 +192,124 @@ public:
 	 */
 	void setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer);
 
+	/**
+	 * Let the background thread look for tiles that were drawn with less than 
+	 * the target quality of the background rasterizer. Call this after the 
+	 * target quality was raised.
+	 */
+	void upgradeTiles();
+
+	/**
+	 * Set a governor to report the time it takes to rasterize tiles to.
+	 */
+	void setQualityGovernor(std::shared_ptr<QualityGovernor> governor) { _qualityGovernor = governor; }
+
 	/**
 	 * Register a callback to call whenever a tile in the cache was updated by 
-	 * the background thread.
+	 * the background thread. The callback is invoked after the change was 
+	 * published to the queue of changed tiles, such that it is safe to call 
+	 * nextChangedTile() in response.
 	 */
 	void setTileChangedCallback(boost::function<void(const util::point<int,2>&)> callback) {
 
 		_tileChangedCallback = callback;
 	}
 
+	/**
+	 * Get the number of tiles in the x direction.
+	 */
+	unsigned int getWidth() const { return _width; }
+
+	/**
+	 * Get the number of tiles in the y direction.
+	 */
+	unsigned int getHeight() const { return _height; }
+
 private:
 
+	/**
+	 * Get the index of the pool slot for a physical tile.
+	 */
+	inline unsigned int getSlot(const util::point<int,2>& physicalTile) const {
+
+		return physicalTile.x()*_height + physicalTile.y();
+	}
+
+	/**
+	 * Get the state of a physical tile.
+	 */
+	inline TileState getTileState(const util::point<int,2>& physicalTile) const {
+
+		return _tileStates[getSlot(physicalTile)].load();
+	}
+
+	/**
+	 * Set the state of the tile in a slot to the given state, unless it has a 
+	 * state of higher precedence already.
+	 */
+	void raiseTileState(unsigned int slot, TileState state);
+
+	/**
+	 * Mark a physical tile as clean and get the state it had before.
+	 */
+	inline TileState takeTileState(const util::point<int,2>& physicalTile) {
+
+		return _tileStates[getSlot(physicalTile)].exchange(Clean);
+	}
+
+	/**
+	 * Make sure the tile in the given slot has a pixel buffer, restoring it from 
+	 * the cold tier if needed. Returns false, if the tile is neither in the 
+	 * pool nor in the cold tier.
+	 */
+	bool makeResident(unsigned int slot);
+
+	/**
+	 * Callback for the tile pool, invoked whenever a slot lost its buffer. 
+	 * Runs while the pool is locked, the content of the buffer is only copied 
+	 * here and compressed later by storeEvictedTiles().
+	 */
+	void onSlotEvicted(unsigned int slot, const sg_gui::skia_pixel_t* buffer);
+
+	/**
+	 * Compress the tiles that were evicted since the last call into the cold 
+	 * tier. Call this after each call to the pool that can evict tiles, 
+	 * without holding any locks.
+	 */
+	void storeEvictedTiles();
+
+	/**
+	 * Callback for the cold tier, invoked whenever a slot had to be dropped.
+	 */
+	void onColdTileDropped(unsigned int slot);
+
+	/**
+	 * Mark the tile in a slot as invalid after it lost its content.
+	 */
+	void invalidateSlot(unsigned int slot);
+
 	/**
 	 * Set the dirty flag of a physical tile.
 	 */
 	inline void markDirtyPhysical(const util::point<int,2>& physicalTile, TileState state);
 
+	/**
+	 * Same as markDirtyPhysical(), but only for the given region of the tile 
+	 * (in pixels relative to the tile).
+	 */
+	inline void markDirtyPhysical(const util::point<int,2>& physicalTile, TileState state, const util::box<int,2>& region);
+
+	/**
+	 * Get and reset the dirty region of a tile (in pixels relative to the 
+	 * tile).
+	 */
+	util::box<int,2> takeDirtyRegion(const util::point<int,2>& physicalTile);
+
+	/**
+	 * Wake up the background thread to look for work.
+	 */
+	void notifyBackgroundRasterizer();
+
 	/**
 	 * Update a tile.
 	 *
@@ -131,18 +322,49 @@ private:
 	 */
 	void updateTile(const util::point<int,2>& physicalTile, const util::box<int,2>& tileRegion, Rasterizer& rasterizer);
 
+	/**
+	 * Redraw a clean tile with the target quality of the given rasterizer.
+	 */
+	void upgradeTile(const util::point<int,2>& physicalTile, const util::box<int,2>& tileRegion, Rasterizer& rasterizer);
+
+	/**
+	 * Draw the content of drawRegion with the given quality into the given 
+	 * buffer, which holds the pixels of tileRegion. The quality is passed to 
+	 * the draw call, the settings of the rasterizer are not changed.
+	 */
+	void rasterize(
+			sg_gui::skia_pixel_t* buffer,
+			const util::box<int,2>& tileRegion,
+			const util::box<int,2>& drawRegion,
+			Rasterizer& rasterizer,
+			Quality quality);
+
+	/**
+	 * Get the shared buffer for tiles with the given uniform content. The 
+	 * buffer is rasterized for tileRegion, if it does not exist yet. Returns 
+	 * an empty pointer if there are too many shared buffers already.
+	 */
+	std::shared_ptr<std::vector<sg_gui::skia_pixel_t>> getUniformBuffer(
+			const UniformContent& content,
+			const util::box<int,2>& tileRegion,
+			Rasterizer& rasterizer);
+
 	/**
 	 * Entry point of the background thread.
 	 */
 	void cleanUp();
 
+	// a test for tiles to be processed by the background thread
+	typedef bool (BasicTilesCache::*TileProbe)(const util::point<int,2>&, util::point<int,2>&, util::box<int,2>&);
+
 	/**
-	 * Find the next dirty tile to clean up.
+	 * Find the next tile around the center for which probe returns true.
 	 */
-	bool findInvalidTile(version_tag::version_type& mappingVersion, util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion);
+	bool findTile(version_tag::version_type& mappingVersion, util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion, TileProbe probe);
 
 	/**
-	 * Clean at most maxNumRequests dirty tiles.
+	 * Clean at most maxNumRequests dirty tiles. If there are no dirty tiles, 
+	 * upgrade the quality of tiles instead.
 	 */
 	unsigned int cleanDirtyTiles(unsigned int maxNumRequests);
 
@@ -152,23 +374,114 @@ private:
 	 */
 	bool isInvalid(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion);
 
-	// 2D array of tiles
-	typedef boost::multi_array<sg_gui::skia_pixel_t, 3> tiles_type;
-	tiles_type  _tiles;
+	/**
+	 * Check whether a logical tile is close enough to the center to be visited 
+	 * by the background thread.
+	 */
+	bool isInCleanUpRadius(const util::point<int,2>& tile);
+
+	/**
+	 * Check whether a logical tile is dirty and was deferred to the background 
+	 * thread by getTile(), get the physical tile and the region covered by it 
+	 * on-the-fly.
+	 */
+	bool isDeferred(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion);
+
+	/**
+	 * Check whether a logical tile is clean but was drawn with less than the 
+	 * target quality of the background rasterizer, get the physical tile and 
+	 * the region covered by it on-the-fly.
+	 */
+	bool needsUpgrade(const util::point<int,2>& tile, util::point<int,2>& physicalTile, util::box<int,2>& tileRegion);
+
+	// the number of tiles in the x and y direction
+	unsigned int _width;
+	unsigned int _height;
+
+	// the pixel memory for the tiles
+	TilePool _pool;
+
+	// compressed copies of clean tiles that are not in the pool
+	CompressedTileStore _coldTiles;
+
+	// a copy of a tile that was evicted from the pool, waiting to be stored 
+	// in the cold tier
+	struct EvictedTile {
+
+		unsigned int                      slot;
+		std::vector<sg_gui::skia_pixel_t> content;
+	};
+
+	// the evicted tiles not stored in the cold tier yet, and buffers for the 
+	// next ones
+	std::vector<EvictedTile>                       _evictedTiles;
+	std::vector<std::vector<sg_gui::skia_pixel_t>> _spareEvictionBuffers;
+
+	// protects _evictedTiles and _spareEvictionBuffers
+	boost::mutex _evictedTilesMutex;
+
+	// makes sure evicted tiles are stored in the order they were evicted in
+	boost::mutex _storeEvictedTilesMutex;
+
+	// the maximal radius around the center in which the background thread 
+	// keeps tiles clean, such that they fit into the pool
+	int _maxCleanUpRadius;
+
+	// the shared buffers for each physical tile that shows no document content 
+	// (empty, if the tile has its own buffer)
+	typedef boost::multi_array<std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>, 2> uniform_tiles_type;
+	uniform_tiles_type _uniformTiles;
 
-	// 2D array of states for the tiles
-	typedef boost::multi_array<TileState, 2> tile_states_type;
-	tile_states_type _tileStates;
+	// all shared buffers by the content they show
+	std::map<UniformContent, std::shared_ptr<std::vector<sg_gui::skia_pixel_t>>> _uniformBuffers;
 
-	// 2D array of changed-flags for the tiles
-	typedef boost::multi_array<bool, 2> tile_changed_type;
-	tile_changed_type _tileChanged;
+	// the maximal number of shared buffers
+	static const unsigned int MaxUniformBuffers = 256;
 
-	// 2D array of mutexes for the tiles
-	boost::mutex _tileMutexes[Width][Height];
+	// protect _uniformBuffers
+	boost::mutex _uniformBuffersMutex;
+
+	// 2D array of the regions of the tiles that need to be redrawn (in pixels 
+	// relative to the tile), accumulated since the last update
+	typedef boost::multi_array<util::box<int,2>, 2> dirty_regions_type;
+	dirty_regions_type _dirtyRegions;
+
+	// protect _dirtyRegions
+	boost::mutex _dirtyRegionsMutex;
+
+	// 2D array of what the rasterizer drew into each tile so far, to perform 
+	// incremental updates per tile
+	typedef boost::multi_array<IncrementalState, 2> incremental_states_type;
+	incremental_states_type _incrementalStates;
+
+	// the states of the tiles by slot, changed by the render thread, the 
+	// background thread, and the eviction callback of the pool (on whichever 
+	// thread needed memory)
+	std::vector<std::atomic<TileState>> _tileStates;
+
+	// 2D array of the quality each tile was drawn with (the lowest, if parts 
+	// of it were drawn with different qualities)
+	typedef boost::multi_array<Quality, 2> tile_qualities_type;
+	tile_qualities_type _tileQualities;
+
+	// 2D array of flags for dirty tiles that getTile() left to the background 
+	// thread, such that only the background thread updates them
+	typedef boost::multi_array<bool, 2> deferred_tiles_type;
+	deferred_tiles_type _deferredTiles;
+
+	// a changed tile in logical coordinates, as it is passed through the queue 
+	// (which requires trivial types)
+	struct ChangedTile {
+
+		int x;
+		int y;
+	};
+
+	// queue of tiles changed by the background thread
+	boost::lockfree::queue<ChangedTile> _changedTiles;
 
 	// mapping from logical tile coordinates to physical coordinates in 2D array
-	torus_mapping<int, Width, Height> _mapping;
+	torus_mapping<int> _mapping;
 
 	// mutex to protect the mapping
 	version_tag  _mappingVersionTag;
@@ -191,9 +504,23 @@ private:
 	// the background rendering thread keeping dirty tiles clean
 	boost::thread _backgroundThread;
 
+	// the governor to report rasterization times to, if any
+	std::shared_ptr<QualityGovernor> _qualityGovernor;
+
 	// callback to call whenever a tile was updated
 	boost::function<void(const util::point<int,2>&)> _tileChangedCallback;
 };
 
+extern template class BasicTilesCache<64>;
+extern template class BasicTilesCache<128>;
+extern template class BasicTilesCache<256>;
+extern template class BasicTilesCache<512>;
+
+static_assert(
+		YANTA_TILE_SIZE == 64 || YANTA_TILE_SIZE == 128 || YANTA_TILE_SIZE == 256 || YANTA_TILE_SIZE == 512,
+		"TILE_SIZE has to be one of the tile sizes instantiated in TilesCache.cpp (64, 128, 256, or 512)");
+
+typedef BasicTilesCache<YANTA_TILE_SIZE> TilesCache;
+
 #endif // YANTA_GUI_TILES_CACHE_H__
 
@@ -0,0 +1,58 @@
+#ifndef YANTA_GUI_TORUS_MAPPING_H__
+#define YANTA_GUI_TORUS_MAPPING_H__
+
+#include <util/torus_mapping.hpp>
+
+/**
+ * A torus_mapping for a grid of Width x Height tiles, where both dimensions 
+ * are powers of two known at compile time. Logical tiles are mapped to 
+ * physical tiles with a bitwise and instead of the modulo arithmetic of 
+ * torus_mapping, which also works for negative coordinates. The region of 
+ * logical tiles is kept by the wrapped torus_mapping.
+ */
+template <unsigned int Width, unsigned int Height>
+class TorusMapping {
+
+	static_assert(Width  > 0 && (Width  & (Width  - 1)) == 0, "the width of a TorusMapping has to be a power of two");
+	static_assert(Height > 0 && (Height & (Height - 1)) == 0, "the height of a TorusMapping has to be a power of two");
+
+public:
+
+	static const int MaskX = Width  - 1;
+	static const int MaskY = Height - 1;
+
+	TorusMapping() :
+		_mapping(Width, Height) {}
+
+	/**
+	 * Set the upper left of the region of logical tiles.
+	 */
+	void reset(const util::point<int,2>& upperLeft) { _mapping.reset(upperLeft); }
+
+	/**
+	 * Move the region of logical tiles by the given amount.
+	 */
+	void shift(const util::point<int,2>& shift) { _mapping.shift(shift); }
+
+	/**
+	 * Get the region of logical tiles.
+	 */
+	util::box<int,2> get_region() const { return _mapping.get_region(); }
+
+	/**
+	 * Get the physical tile of a logical tile.
+	 */
+	inline util::point<int,2> map(const util::point<int,2>& tile) const {
+
+		// two's complement makes this the positive remainder for negative 
+		// coordinates as well
+		return util::point<int,2>(tile.x() & MaskX, tile.y() & MaskY);
+	}
+
+private:
+
+	torus_mapping<int> _mapping;
+};
+
+#endif // YANTA_GUI_TORUS_MAPPING_H__
+
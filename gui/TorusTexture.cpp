@@ -1,47 +1,136 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/timer/timer.hpp>
+
+#include <util/ProgramOptions.h>
 #include "TorusTexture.h"
 
 logger::LogChannel torustexturelog("torustexturelog", "[TorusTexture] ");
 
-TorusTexture::TorusTexture(const util::box<int,2>& region) :
+util::ProgramOption optionMaxTileUploadsPerFrame(
+		util::_long_name        = "maxTileUploadsPerFrame",
+		util::_description_text = "The maximal number of tiles to upload to the texture per frame.",
+		util::_default_value    = 16);
+
+util::ProgramOption optionMaxRasterizationTimePerFrame(
+		util::_long_name        = "maxRasterizationTimePerFrame",
+		util::_description_text = "The maximal time (in milliseconds) to spend on updating dirty tiles for one frame. Tiles that "
+		                          "don't fit into this budget are updated in the background, their previous content is shown meanwhile.",
+		util::_default_value    = 8);
+
+namespace {
+
+// the number of pixel buffers to cycle through
+const unsigned int NumPixelBuffers = 3;
+
+// the pixel format of skia's N32 pixels on little-endian machines
+const GLenum TileUploadFormat = GL_BGRA;
+
+// order uploads by rows, such that horizontally adjacent tiles follow each 
+// other
+struct RowMajor {
+
+	template <typename UploadType>
+	bool operator()(const UploadType& a, const UploadType& b) const {
+
+		if (a.physicalTile.y() != b.physicalTile.y())
+			return a.physicalTile.y() < b.physicalTile.y();
+
+		return a.physicalTile.x() < b.physicalTile.x();
+	}
+};
+
+} // anonymous namespace
+
+template <unsigned int Size>
+BasicTorusTexture<Size>::BasicTorusTexture(const util::box<int,2>& region) :
 	_width (region.width() /TileSize + 10),
 	_height(region.height()/TileSize + 10),
 	_outOfDates(boost::extents[_width][_height]),
+	_uploadedUniforms(boost::extents[_width][_height]),
 	_mapping(_width, _height),
-	_texture(0) {
+	// the tiles cache has to contain at least the tiles that we need, and it 
+	// should keep them in memory
+	_cache(
+			std::max(_width,  static_cast<unsigned int>(cache_type::DefaultWidth)),
+			std::max(_height, static_cast<unsigned int>(cache_type::DefaultHeight)),
+			_width*_height),
+	_texture(0),
+	_quadTiles(0, 0, 0, 0),
+	_quadsChanged(false),
+	_shown(boost::extents[_width][_height]),
+	_backdropTexture(0),
+	_haveBackdrop(false),
+	_backdropScale(1.0),
+	_backdropOffset(0, 0),
+	_haveUploads(false),
+	_uploadsCopied(false),
+	_uploadMemory(0),
+	_uploadRasterizer(0),
+	_targetQuality(Auto),
+	_maxUploads(std::max(optionMaxTileUploadsPerFrame.as<unsigned int>(), 1u)),
+	_rasterizationBudget(optionMaxRasterizationTimePerFrame.as<double>()*1e-3),
+	_stopUploadThread(false),
+	_uploadThread(boost::bind(&BasicTorusTexture::copyTiles, this)) {
 
 	LOG_DEBUG(torustexturelog) << "creating new torus texture with " << _width << "x" << _height << " tiles to cover " << region << std::endl;
 
-	// the tiles cache has to contain at least the tiles that we need
-	assert(_width  <= TilesCache::Width);
-	assert(_height <= TilesCache::Height);
-
 	reset(region.center());
 
 	sg_gui::OpenGl::Guard guard;
 
 	_texture = new sg_gui::Texture(_width*TileSize, _height*TileSize, GL_RGBA);
 
+	_pixelBuffers.reset(new PixelBufferRing(NumPixelBuffers, _maxUploads*TileSize*TileSize*sizeof(sg_gui::skia_pixel_t)));
+
+	_quads.reset(new QuadBatch());
+	_backdropQuads.reset(new QuadBatch());
+
 	for (unsigned int i = 0; i < TileSize*TileSize; i++)
 		_notDoneImage[i] = sg_gui::skia_pixel_t(255, 0, 0, 255);
 
-	_cache.setTileChangedCallback(boost::bind(&TorusTexture::onTileChacheChanged, this, _1));
+	_cache.setTileChangedCallback(boost::bind(&BasicTorusTexture::onTileChacheChanged, this, _1));
 }
 
-TorusTexture::~TorusTexture() {
+template <unsigned int Size>
+BasicTorusTexture<Size>::~BasicTorusTexture() {
+
+	{
+		boost::lock_guard<boost::mutex> lock(_uploadMutex);
+		_stopUploadThread = true;
+	}
+
+	_uploadCondition.notify_all();
+	_uploadThread.join();
 
 	sg_gui::OpenGl::Guard guard;
 
+	// deleting the buffers unmaps them as well
+	_pixelBuffers.reset();
+	_quads.reset();
+	_backdropQuads.reset();
+
 	if (_texture)
 		delete _texture;
+
+	if (_backdropTexture)
+		delete _backdropTexture;
 }
 
+template <unsigned int Size>
 void
-TorusTexture::reset(const util::point<int,2>& center) {
+BasicTorusTexture<Size>::reset(const util::point<int,2>& center) {
 
 	LOG_DEBUG(torustexturelog) << "reseting torus texture around " << center << std::endl;
 
+	// the current uploads are for the old content
+	discardUploads();
+
 	// get the tile containing the center
-	util::point<int,2> centerTile(getTileCoordinate(center.x()), getTileCoordinate(center.y()));
+	util::point<int,2> centerTile(cache_type::getTileCoordinate(center.x()), cache_type::getTileCoordinate(center.y()));
 
 	// reset the tile mapping, such that all tiles around center map to 
 	// [0,w)x[0,h)
@@ -57,19 +146,35 @@ TorusTexture::reset(const util::point<int,2>& center) {
 	// center the cache around our center tile as well
 	_cache.reset(util::point<int,2>(centerTile.x(), centerTile.y()));
 
-	// mark all tiles as need-update
 	for (unsigned int x = 0; x < _width; x++)
-		for (unsigned int y = 0; y < _height; y++)
-			_outOfDates[x][y] = true;
+		for (unsigned int y = 0; y < _height; y++) {
+
+			_uploadedUniforms[x][y] = 0;
+			_shown[x][y]            = false;
+		}
+
+	_quadsChanged = true;
+
+	// mark all tiles as need-update
+	_pendingTiles.clear();
+	util::box<int,2> tiles = _mapping.get_region();
+	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+		for (int y = tiles.min().y(); y < tiles.max().y(); y++)
+			markOutOfDate(util::point<int,2>(x, y), true);
 }
 
+template <unsigned int Size>
 void
-TorusTexture::shift(const util::point<int,2>& shift) {
+BasicTorusTexture<Size>::shift(const util::point<int,2>& shift) {
 
 	_shift += shift;
 
 	LOG_ALL(torustexturelog) << "shifting texture content by " << shift << ", accumulated shift is " << _shift << std::endl;
 
+	// the current uploads might be for tiles that get shifted out
+	if (std::abs(_shift.x()) >= (int)TileSize || std::abs(_shift.y()) >= (int)TileSize)
+		discardUploads();
+
 	// We are shifting content out of the region covered by this texture.
 	//
 	// If we shifted far enough to the right, such that a whole column of tiles 
@@ -87,7 +192,7 @@ TorusTexture::shift(const util::point<int,2>& shift) {
 		util::box<int,2> tilesRegion = _mapping.get_region();
 		int x = tilesRegion.min().x();
 		for (int y = tilesRegion.min().y(); y < tilesRegion.max().y(); y++)
-			markDirty(util::point<int,2>(x, y), OutOfDate);
+			markDirty(util::point<int,2>(x, y), OutOfDate, util::box<int,2>(0, 0, 0, 0));
 	}
 	while (_shift.x() <= -(int)TileSize) {
 
@@ -99,7 +204,7 @@ TorusTexture::shift(const util::point<int,2>& shift) {
 		util::box<int,2> tilesRegion = _mapping.get_region();
 		int x = tilesRegion.max().x() - 1;
 		for (int y = tilesRegion.min().y(); y < tilesRegion.max().y(); y++)
-			markDirty(util::point<int,2>(x, y), OutOfDate);
+			markDirty(util::point<int,2>(x, y), OutOfDate, util::box<int,2>(0, 0, 0, 0));
 	}
 	while (_shift.y() >= (int)TileSize) {
 
@@ -111,7 +216,7 @@ TorusTexture::shift(const util::point<int,2>& shift) {
 		util::box<int,2> tilesRegion = _mapping.get_region();
 		int y = tilesRegion.min().y();
 		for (int x = tilesRegion.min().x(); x < tilesRegion.max().x(); x++)
-			markDirty(util::point<int,2>(x, y), OutOfDate);
+			markDirty(util::point<int,2>(x, y), OutOfDate, util::box<int,2>(0, 0, 0, 0));
 	}
 	while (_shift.y() <= -(int)TileSize) {
 
@@ -123,26 +228,77 @@ TorusTexture::shift(const util::point<int,2>& shift) {
 		util::box<int,2> tilesRegion = _mapping.get_region();
 		int y = tilesRegion.max().y() - 1;
 		for (int x = tilesRegion.min().x(); x < tilesRegion.max().x(); x++)
-			markDirty(util::point<int,2>(x, y), OutOfDate);
+			markDirty(util::point<int,2>(x, y), OutOfDate, util::box<int,2>(0, 0, 0, 0));
 	}
 
 	LOG_ALL(torustexturelog) << "  cache region is now " << _mapping.get_region() << std::endl;
 }
 
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::zoom(double ratio, const util::point<int,2>& anchor) {
+
+	LOG_DEBUG(torustexturelog) << "zooming by " << ratio << " around " << anchor << std::endl;
+
+	// the current uploads are for the old scale
+	discardUploads();
+
+	util::point<double,2> anchorPoint(anchor.x(), anchor.y());
+
+	// the tiles that were visible in the last frame
+	util::box<int,2> visibleTiles = _mapping.get_region().intersection(_quadTiles);
+
+	// Keep the current content as the backdrop, unless it is incomplete and 
+	// there is a backdrop already. In this case, the previous backdrop shows 
+	// more.
+	if (!_haveBackdrop || allShown(visibleTiles)) {
+
+		LOG_DEBUG(torustexturelog) << "keeping current content as backdrop" << std::endl;
+
+		sg_gui::OpenGl::Guard guard;
+
+		if (!_backdropTexture)
+			_backdropTexture = new sg_gui::Texture(_width*TileSize, _height*TileSize, GL_RGBA);
+
+		std::swap(_texture, _backdropTexture);
+
+		_backdropQuads->clear();
+		addShownTiles(*_backdropQuads, visibleTiles);
+
+		_haveBackdrop   = true;
+		_backdropScale  = 1.0;
+		_backdropOffset = util::point<double,2>(0, 0);
+	}
+
+	// pixel p of the backdrop was shown at p*_backdropScale + _backdropOffset 
+	// so far, scale this around the anchor
+	_backdropScale  *= ratio;
+	_backdropOffset  = anchorPoint + (_backdropOffset - anchorPoint)*ratio;
+
+	// the center of the texture moves with the content
+	util::point<int,2>    center = _mapping.get_region().center()*static_cast<int>(TileSize);
+	util::point<double,2> zoomedCenter = anchorPoint + (util::point<double,2>(center.x(), center.y()) - anchorPoint)*ratio;
+
+	reset(util::point<int,2>(std::floor(zoomedCenter.x()), std::floor(zoomedCenter.y())));
+}
+
+template <unsigned int Size>
 void
-TorusTexture::markDirty(const util::box<int,2>& region, DirtyFlag dirtyFlag) {
+BasicTorusTexture<Size>::markDirty(const util::box<int,2>& region, DirtyFlag dirtyFlag) {
 
 	// get the tiles in the region
 	util::box<int,2> tiles = getTiles(region);
 
-	// mark them dirty
+	// mark them dirty, the cache will only redraw the part of each tile that 
+	// intersects region
 	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
 		for (int y = tiles.min().y(); y < tiles.max().y(); y++)
-			markDirty(util::point<int,2>(x, y), dirtyFlag);
+			markDirty(util::point<int,2>(x, y), dirtyFlag, region);
 }
 
+template <unsigned int Size>
 void
-TorusTexture::render(const util::box<int,2>& region, Rasterizer& rasterizer) {
+BasicTorusTexture<Size>::render(const util::box<int,2>& region, Rasterizer& rasterizer) {
 
 	LOG_ALL(torustexturelog) << "called render for " << region << std::endl;
 
@@ -163,189 +319,570 @@ TorusTexture::render(const util::box<int,2>& region, Rasterizer& rasterizer) {
 		return;
 	}
 
-	// are all out-of-date tiles updated?
-	bool allDone = false;
+	// upload the tiles that were copied since the last frame
+	finishUploads();
 
-	// try at most two times to get all the tiles
-	for (int i = 0; i < 2 && !allDone; i++) {
+	// Tiles drawn with less than a raised target quality can be upgraded now. 
+	// The upload thread changes the quality of the rasterizer while it copies 
+	// a batch, the target quality can only be read in between.
+	bool haveUploads;
+	{
+		boost::lock_guard<boost::mutex> lock(_uploadMutex);
+		haveUploads = _haveUploads;
+	}
 
-		// assume everything is okay
-		allDone = true;
+	if (!haveUploads) {
 
-		// TODO: make this more efficient (by using a queue of reload requests)
-		for (int x = tiles.min().x(); x < tiles.max().x(); x++)
-			for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
+		Quality targetQuality = rasterizer.getTargetQuality();
+		if (targetQuality > _targetQuality)
+			_cache.upgradeTiles();
+		_targetQuality = targetQuality;
+	}
 
-				util::point<int,2> tile(x, y);
-				util::point<int,2> physicalTile = _mapping.map(tile);
+	// find out which tiles the cache changed since the last frame
+	processCacheChanges();
 
-				bool needUpdate = false;
+	// hand the next changed tiles to the upload thread
+	startUploads(tiles, rasterizer);
 
-				if (_cache.wasChanged(tile)) {
+	// the backdrop is not needed anymore once all visible tiles are shown
+	if (_haveBackdrop && allShown(tiles)) {
 
-					LOG_ALL(torustexturelog) << "tile " << tile << " was changed in the cache" << std::endl;
+		LOG_DEBUG(torustexturelog) << "all visible tiles are shown, dropping backdrop" << std::endl;
 
-					needUpdate = true;
-					_cache.seenChange(tile);
-				}
+		_haveBackdrop = false;
+		_quadsChanged = true;
+	}
 
-				if (_outOfDates[physicalTile.x()][physicalTile.y()]) {
+	// draw the texture
+	glEnable(GL_TEXTURE_2D);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-					LOG_ALL(torustexturelog) << "tile " << tile << " is marked out-of-date" << std::endl;
+	// the quads only change with the visible tiles or the mapping
+	util::point<int,2> physicalUpperLeft = _mapping.map(tiles.min());
+	if (_quadsChanged || !(tiles.min() == _quadTiles.min() && tiles.max() == _quadTiles.max() && physicalUpperLeft == _quadPhysicalUpperLeft)) {
 
-					needUpdate = true;
-				}
+		updateQuads(tiles);
 
-				if (needUpdate) {
+		_quadTiles             = tiles;
+		_quadPhysicalUpperLeft = physicalUpperLeft;
+		_quadsChanged          = false;
+	}
 
-					bool done = reloadTile(tile, physicalTile, rasterizer);
+	if (_haveBackdrop) {
 
-					allDone = allDone && done;
-				}
-			}
+		glPushMatrix();
+		glTranslated(_backdropOffset.x(), _backdropOffset.y(), 0);
+		glScaled(_backdropScale, _backdropScale, 1);
+
+		_backdropTexture->bind();
+		_backdropQuads->draw();
+		_backdropTexture->unbind();
+
+		glPopMatrix();
 	}
 
-	// draw the texture
-	glEnable(GL_TEXTURE_2D);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	_texture->bind();
+	_quads->draw();
+	_texture->unbind();
+
+	glDisable(GL_BLEND);
+}
+
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::updateQuads(const util::box<int,2>& tiles) {
 
-	// The texture is in general split into four parts that we have to draw 
-	// individually.
+	LOG_ALL(torustexturelog) << "updating quads for tiles " << tiles << std::endl;
+
+	_quads->clear();
+
+	// Tiles that don't show their content would hide the backdrop.
+	if (_haveBackdrop) {
+
+		addShownTiles(*_quads, tiles);
+		return;
+	}
+
+	// The texture is in general split into four parts, each of them drawn 
+	// with its own quad.
 
 	util::box<int,2> subtiles[4];
 	_mapping.split(tiles, subtiles);
 
-	_texture->bind();
-
-	// for each part...
 	for (int i = 0; i < 4; i++) {
 
-		LOG_ALL(torustexturelog) << "attempting to draw part " << i << " with tiles " << subtiles[i] << std::endl;
-
 		if (subtiles[i].area() <= 0)
 			continue;
 
-		LOG_ALL(torustexturelog) << "drawing texture part " << i << std::endl;
-
 		// the region covered by this part in pixels
-		util::box<int,2> subregion = subtiles[i]*static_cast<int>(TileSize);
+		util::box<float,2> subregion(
+				subtiles[i].min().x()*static_cast<int>(TileSize),
+				subtiles[i].min().y()*static_cast<int>(TileSize),
+				subtiles[i].max().x()*static_cast<int>(TileSize),
+				subtiles[i].max().y()*static_cast<int>(TileSize));
 
 		util::point<int,2> physicalUpperLeft  = _mapping.map(subtiles[i].min());
 		util::point<int,2> physicalLowerRight = physicalUpperLeft + util::point<int,2>(subtiles[i].width(), subtiles[i].height());
 
 		// the texCoords as tiles in the texture
-		util::box<double,2> texCoords(physicalUpperLeft.x(), physicalUpperLeft.y(), physicalLowerRight.x(), physicalLowerRight.y());
+		util::box<float,2> texCoords(physicalUpperLeft.x(), physicalUpperLeft.y(), physicalLowerRight.x(), physicalLowerRight.y());
 		// normalized to [0,1)x[0,1)
-		texCoords /= util::point<double,2>(_width, _height);
-
-#ifndef NDEBUG
-		int r = rand()%255;
-		int g = rand()%255;
-		int b = 255;
-		glColor3i(r, g, b);
-		LOG_ALL(torustexturelog) << "rgb = " << r << " " << g << " " << b << std::endl;
-		glDisable(GL_TEXTURE_2D);
-		glDisable(GL_BLEND);
-#endif
-
-		// draw the texture part
-		glBegin(GL_QUADS);
-		glTexCoord2d(texCoords.min().x(), texCoords.min().y()); glVertex2d(subregion.min().x(), subregion.min().y());
-		glTexCoord2d(texCoords.max().x(), texCoords.min().y()); glVertex2d(subregion.max().x(), subregion.min().y());
-		glTexCoord2d(texCoords.max().x(), texCoords.max().y()); glVertex2d(subregion.max().x(), subregion.max().y());
-		glTexCoord2d(texCoords.min().x(), texCoords.max().y()); glVertex2d(subregion.min().x(), subregion.max().y());
-		glEnd();
+		texCoords /= util::point<float,2>(_width, _height);
+
+		_quads->add(subregion, texCoords);
 	}
+}
 
-	_texture->unbind();
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::addShownTiles(QuadBatch& quads, const util::box<int,2>& tiles) {
 
-	glDisable(GL_BLEND);
+	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+		for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
+
+			util::point<int,2> physicalTile = _mapping.map(util::point<int,2>(x, y));
+
+			if (!_shown[physicalTile.x()][physicalTile.y()])
+				continue;
+
+			util::box<float,2> position(x, y, x + 1, y + 1);
+			position *= static_cast<float>(TileSize);
+
+			util::box<float,2> texCoords(physicalTile.x(), physicalTile.y(), physicalTile.x() + 1, physicalTile.y() + 1);
+			texCoords /= util::point<float,2>(_width, _height);
+
+			quads.add(position, texCoords);
+		}
 }
 
+template <unsigned int Size>
+bool
+BasicTorusTexture<Size>::allShown(const util::box<int,2>& tiles) {
+
+	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+		for (int y = tiles.min().y(); y < tiles.max().y(); y++) {
+
+			util::point<int,2> physicalTile = _mapping.map(util::point<int,2>(x, y));
+
+			if (!_shown[physicalTile.x()][physicalTile.y()])
+				return false;
+		}
+
+	return true;
+}
+
+template <unsigned int Size>
 void
-TorusTexture::setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer) {
+BasicTorusTexture<Size>::setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer) {
 
 	_cache.setBackgroundRasterizer(rasterizer);
 }
 
+template <unsigned int Size>
 util::box<int,2>
-TorusTexture::getTiles(const util::box<int,2>& region) {
+BasicTorusTexture<Size>::getTiles(const util::box<int,2>& region) {
 
 	util::box<int,2> tiles;
 
-	tiles.min().x() = getTileCoordinate(region.min().x());
-	tiles.min().y() = getTileCoordinate(region.min().y());
-	tiles.max().x() = getTileCoordinate(region.max().x() - 1) + 1;
-	tiles.max().y() = getTileCoordinate(region.max().y() - 1) + 1;
+	tiles.min().x() = cache_type::getTileCoordinate(region.min().x());
+	tiles.min().y() = cache_type::getTileCoordinate(region.min().y());
+	tiles.max().x() = cache_type::getTileCoordinate(region.max().x() - 1) + 1;
+	tiles.max().y() = cache_type::getTileCoordinate(region.max().y() - 1) + 1;
 
 	return tiles;
 }
 
-int
-TorusTexture::getTileCoordinate(int pixel) {
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::markDirty(const util::point<int,2>& tile, DirtyFlag dirtyFlag, const util::box<int,2>& region) {
 
-	return pixel/static_cast<int>(TileSize) - (pixel < 0 ? 1 : 0);
+	LOG_ALL(torustexturelog) << "marking dirty tile " << tile << std::endl;
+
+	// Mark the tile out-of-date in the texture. Tiles marked OutOfDate are 
+	// newly shifted in, their physical tile might still be flagged for the 
+	// tile that was there before.
+	markOutOfDate(tile, dirtyFlag == OutOfDate);
+
+	// NeedsRedraw and NeedsUpdate have to be propagated to the cache
+	if (dirtyFlag == NeedsRedraw)
+		_cache.markDirty(tile, cache_type::NeedsRedraw, region);
+	else if (dirtyFlag == NeedsUpdate)
+		_cache.markDirty(tile, cache_type::NeedsUpdate, region);
 }
 
+template <unsigned int Size>
 void
-TorusTexture::markDirty(const util::point<int,2>& tile, DirtyFlag dirtyFlag) {
+BasicTorusTexture<Size>::markOutOfDate(const util::point<int,2>& tile, bool force) {
 
-	LOG_ALL(torustexturelog) << "marking dirty tile " << tile << std::endl;
+	if (!_mapping.get_region().contains(tile))
+		return;
 
-	// mark the tile out-of-date in the texture
-	if (_mapping.get_region().contains(tile)) {
+	LOG_ALL(torustexturelog) << "    marking out-of-date tile " << tile << std::endl;
 
-		LOG_ALL(torustexturelog) << "    marking out-of-date tile " << tile << std::endl;
+	util::point<int,2> physicalTile = _mapping.map(tile);
 
-		util::point<int,2> physicalTile = _mapping.map(tile);
-		_outOfDates[physicalTile.x()][physicalTile.y()] = true;
+	LOG_ALL(torustexturelog) << "    physical tile is " << physicalTile << std::endl;
+
+	bool& outOfDate = _outOfDates[physicalTile.x()][physicalTile.y()];
+
+	if (!outOfDate || force)
+		_pendingTiles.push_back(tile);
+
+	outOfDate = true;
+}
+
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::processCacheChanges() {
+
+	util::point<int,2> tile;
 
-		LOG_ALL(torustexturelog) << "    physical tile is " << physicalTile << std::endl;
+	while (_cache.nextChangedTile(tile)) {
+
+		LOG_ALL(torustexturelog) << "tile " << tile << " was changed in the cache" << std::endl;
+
+		markOutOfDate(tile);
 	}
+}
 
-	// NeedsRedraw and NeedsUpdate have to be propagated to the cache
-	if (dirtyFlag == NeedsRedraw)
-		_cache.markDirty(tile, TilesCache::NeedsRedraw);
-	else if (dirtyFlag == NeedsUpdate)
-		_cache.markDirty(tile, TilesCache::NeedsUpdate);
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::startUploads(const util::box<int,2>& tiles, Rasterizer& rasterizer) {
+
+	{
+		boost::lock_guard<boost::mutex> lock(_uploadMutex);
+
+		// the upload thread is still busy with the previous batch
+		if (_haveUploads)
+			return;
+	}
+
+	if (_pendingTiles.empty())
+		return;
+
+	_uploads.clear();
+
+	// Take the pending tiles that are visible first, then the others. Stale 
+	// entries (tiles that were shifted out or are up-to-date already) are 
+	// dropped on the way.
+	for (int pass = 0; pass < 2 && _uploads.size() < _maxUploads; pass++) {
+
+		std::vector<util::point<int,2>>::iterator kept = _pendingTiles.begin();
+
+		for (std::vector<util::point<int,2>>::iterator i = _pendingTiles.begin(); i != _pendingTiles.end(); i++) {
+
+			const util::point<int,2>& tile = *i;
+
+			if (!_mapping.get_region().contains(tile))
+				continue;
+
+			util::point<int,2> physicalTile = _mapping.map(tile);
+
+			if (!_outOfDates[physicalTile.x()][physicalTile.y()])
+				continue;
+
+			if (_uploads.size() >= _maxUploads || (pass == 0 && !tiles.contains(tile))) {
+
+				*kept++ = tile;
+				continue;
+			}
+
+			LOG_ALL(torustexturelog) << "tile " << tile << " is out-of-date" << std::endl;
+
+			Upload upload;
+			upload.tile         = tile;
+			upload.physicalTile = physicalTile;
+			upload.needed       = true;
+			upload.done         = false;
+
+			_uploads.push_back(upload);
+
+			// Assume the upload succeeds. If the tile gets marked out-of-date 
+			// while it is uploaded, it will be uploaded again.
+			_outOfDates[physicalTile.x()][physicalTile.y()] = false;
+		}
+
+		_pendingTiles.erase(kept, _pendingTiles.end());
+	}
+
+	if (_uploads.empty())
+		return;
+
+	// arrange the uploads in runs of horizontally adjacent tiles, each run is 
+	// stored as one image in the pixel buffer
+	std::sort(_uploads.begin(), _uploads.end(), RowMajor());
+
+	std::size_t offset = 0;
+	for (unsigned int i = 0; i < _uploads.size();) {
+
+		unsigned int length = 1;
+		while (
+				i + length < _uploads.size() &&
+				_uploads[i + length].physicalTile.y() == _uploads[i].physicalTile.y() &&
+				_uploads[i + length].physicalTile.x() == _uploads[i].physicalTile.x() + static_cast<int>(length))
+			length++;
+
+		for (unsigned int j = 0; j < length; j++) {
+
+			_uploads[i + j].runOffset   = offset;
+			_uploads[i + j].runLength   = length;
+			_uploads[i + j].runPosition = j;
+		}
+
+		offset += length*TileSize*TileSize;
+		i      += length;
+	}
+
+	_uploadMemory = static_cast<sg_gui::skia_pixel_t*>(_pixelBuffers->map());
+
+	if (!_uploadMemory) {
+
+		for (unsigned int i = 0; i < _uploads.size(); i++)
+			markOutOfDate(_uploads[i].tile);
+
+		return;
+	}
+
+	LOG_ALL(torustexturelog) << "handing " << _uploads.size() << " tiles to the upload thread" << std::endl;
+
+	{
+		boost::lock_guard<boost::mutex> lock(_uploadMutex);
+
+		_uploadRasterizer = &rasterizer;
+		_haveUploads      = true;
+		_uploadsCopied    = false;
+	}
+
+	_uploadCondition.notify_all();
 }
 
-bool
-TorusTexture::reloadTile(const util::point<int,2>& tile, const util::point<int,2>& physicalTile, Rasterizer& rasterizer) {
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::finishUploads() {
 
-	LOG_ALL(torustexturelog) << "reloading tile " << tile << std::endl;
-	LOG_ALL(torustexturelog) << "    physical tile is " << physicalTile << std::endl;
+	{
+		boost::lock_guard<boost::mutex> lock(_uploadMutex);
+
+		if (!_haveUploads || !_uploadsCopied)
+			return;
+	}
 
-	// get the tile's data (and update it on-the-fly, if needed)
-	sg_gui::skia_pixel_t* data = _cache.getTile(tile, rasterizer);
+	LOG_ALL(torustexturelog) << "uploading " << _uploads.size() << " tiles" << std::endl;
 
-	// get the target area within the texture
-	util::box<int,2> textureRegion(physicalTile.x(), physicalTile.y(), physicalTile.x() + 1, physicalTile.y() + 1);
-	textureRegion *= static_cast<int>(TileSize);
+	bool valid = _pixelBuffers->unmapAndBind();
+
+	if (valid) {
+
+		_texture->bind();
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		// upload each sequence of needed tiles within a run at once
+		for (unsigned int i = 0; i < _uploads.size();) {
+
+			const Upload& first = _uploads[i];
+
+			if (!first.needed) {
+
+				i++;
+				continue;
+			}
+
+			unsigned int length = 1;
+			while (
+					i + length < _uploads.size() &&
+					_uploads[i + length].runOffset == first.runOffset &&
+					_uploads[i + length].needed)
+				length++;
+
+			// the pixel buffer rows are as long as the whole run
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, first.runLength*TileSize);
+
+			std::size_t offset = first.runOffset + first.runPosition*TileSize;
+
+			glTexSubImage2D(
+					GL_TEXTURE_2D,
+					0,
+					first.physicalTile.x()*TileSize,
+					first.physicalTile.y()*TileSize,
+					length*TileSize,
+					TileSize,
+					TileUploadFormat,
+					GL_UNSIGNED_BYTE,
+					reinterpret_cast<const GLvoid*>(offset*sizeof(sg_gui::skia_pixel_t)));
+
+			i += length;
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		_texture->unbind();
+	}
+
+	_pixelBuffers->unbind();
+
+	// remember which tiles show their content now
+	if (valid)
+		for (unsigned int i = 0; i < _uploads.size(); i++) {
+
+			bool& shown = _shown[_uploads[i].physicalTile.x()][_uploads[i].physicalTile.y()];
+
+			if (shown != _uploads[i].done) {
+
+				shown = _uploads[i].done;
+
+				if (_haveBackdrop)
+					_quadsChanged = true;
+			}
+		}
+
+	// tiles that were not ready or got lost have to be uploaded again
+	for (unsigned int i = 0; i < _uploads.size(); i++) {
+
+		// the uniform content of lost tiles did not make it to the texture 
+		// either
+		if (!valid) {
+
+			util::point<int,2> physicalTile = _uploads[i].physicalTile;
+			_uploadedUniforms[physicalTile.x()][physicalTile.y()] = 0;
+		}
+
+		if (!valid || !_uploads[i].done)
+			markOutOfDate(_uploads[i].tile);
+	}
+
+	boost::lock_guard<boost::mutex> lock(_uploadMutex);
+	_haveUploads = false;
+}
+
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::discardUploads() {
+
+	boost::unique_lock<boost::mutex> lock(_uploadMutex);
+
+	if (!_haveUploads)
+		return;
+
+	LOG_DEBUG(torustexturelog) << "discarding " << _uploads.size() << " uploads" << std::endl;
+
+	while (!_uploadsCopied)
+		_uploadCondition.wait(lock);
+
+	// we might be called from outside of render()
+	sg_gui::OpenGl::Guard guard;
+
+	_pixelBuffers->unmapAndBind();
+	_pixelBuffers->unbind();
+
+	for (unsigned int i = 0; i < _uploads.size(); i++) {
+
+		util::point<int,2> physicalTile = _uploads[i].physicalTile;
+
+		_uploadedUniforms[physicalTile.x()][physicalTile.y()] = 0;
+		markOutOfDate(_uploads[i].tile);
+	}
+
+	_haveUploads = false;
+}
+
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::copyTiles() {
+
+	LOG_DEBUG(torustexturelog) << "upload thread started" << std::endl;
+
+	while (true) {
+
+		Rasterizer* rasterizer;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_uploadMutex);
+
+			while (!_stopUploadThread && (!_haveUploads || _uploadsCopied))
+				_uploadCondition.wait(lock);
+
+			if (_stopUploadThread)
+				break;
+
+			rasterizer = _uploadRasterizer;
+		}
+
+		// Dirty tiles are updated while copying them, as long as there is time 
+		// left for this batch. The cache leaves the others to its background 
+		// thread.
+		boost::timer::cpu_timer rasterizationTimer;
+
+		// The render thread does not touch the batch until we are done.
+		for (unsigned int i = 0; i < _uploads.size(); i++)
+			copyTile(_uploads[i], *rasterizer, rasterizationTimer.elapsed().wall*1e-9 < _rasterizationBudget);
+
+		{
+			boost::lock_guard<boost::mutex> lock(_uploadMutex);
+			_uploadsCopied = true;
+		}
+
+		_uploadCondition.notify_all();
+	}
+
+	LOG_DEBUG(torustexturelog) << "upload thread stopped" << std::endl;
+}
+
+template <unsigned int Size>
+void
+BasicTorusTexture<Size>::copyTile(Upload& upload, Rasterizer& rasterizer, bool mayRasterize) {
+
+	LOG_ALL(torustexturelog) << "copying tile " << upload.tile << std::endl;
+	LOG_ALL(torustexturelog) << "    physical tile is " << upload.physicalTile << std::endl;
+
+	// get the tile's data (and update it on-the-fly, if needed and allowed)
+	bool uniform;
+	const sg_gui::skia_pixel_t* data = _cache.getTile(upload.tile, rasterizer, &uniform, mayRasterize);
+
+	const sg_gui::skia_pixel_t*& uploaded = _uploadedUniforms[upload.physicalTile.x()][upload.physicalTile.y()];
+
+	upload.done = (data != 0);
 
-	// partially reload the texture
 	if (data == 0) {
 
 		LOG_ALL(torustexturelog) << "    tile is not ready, yet -- showing not-done image" << std::endl;
 
-		_texture->loadData(_notDoneImage, textureRegion);
+		data     = _notDoneImage;
+		uploaded = 0;
 
-		return false;
+	} else if (uniform && uploaded == data) {
 
-	} else {
+		// shared buffers don't change, no need to upload the same one again
+		LOG_ALL(torustexturelog) << "    tile shows the same uniform content already" << std::endl;
 
-		_texture->loadData(data, textureRegion);
+		upload.needed = false;
+		_cache.releaseTile(data);
+		return;
 
-		// mark tile as up-to-date
-		_outOfDates[physicalTile.x()][physicalTile.y()] = false;
+	} else {
 
-		return true;
+		uploaded = (uniform ? data : 0);
 	}
+
+	// copy the tile into its column of the run
+	sg_gui::skia_pixel_t* target  = _uploadMemory + upload.runOffset + upload.runPosition*TileSize;
+	std::size_t           stride  = upload.runLength*TileSize;
+
+	for (unsigned int row = 0; row < TileSize; row++)
+		std::memcpy(
+				static_cast<void*>(target + row*stride),
+				data + row*TileSize,
+				TileSize*sizeof(sg_gui::skia_pixel_t));
+
+	if (upload.done)
+		_cache.releaseTile(data);
 }
 
+template <unsigned int Size>
 void
-TorusTexture::onTileChacheChanged(const util::point<int,2>& tile) {
+BasicTorusTexture<Size>::onTileChacheChanged(const util::point<int,2>& tile) {
 
 	// TODO: re-enable without Slot
 	//if (_contentChanged) {
@@ -357,3 +894,10 @@ TorusTexture::onTileChacheChanged(const util::point<int,2>& tile) {
 		//}
 	//}
 }
+
+// the tile sizes to choose from with the CMake option TILE_SIZE
+template class BasicTorusTexture<64>;
+template class BasicTorusTexture<128>;
+template class BasicTorusTexture<256>;
+template class BasicTorusTexture<512>;
+
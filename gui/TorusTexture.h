@@ -1,9 +1,16 @@
 #ifndef YANTA_GUI_TORUS_TEXTURE_H__
 #define YANTA_GUI_TORUS_TEXTURE_H__
 
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+
 #include <sg_gui/Texture.h>
 
 #include <util/torus_mapping.hpp>
+#include "PixelBufferRing.h"
+#include "QuadBatch.h"
 #include "Rasterizer.h"
 #include "TilesCache.h"
 
@@ -11,8 +18,23 @@
  * A texture that can efficiently shift its content by wrapping it around the 
  * edges. This is done virtually by splitting the texture according to a torus 
  * mapping from logical (content) coordinates to physical (texture) coordinates.
+ *
+ * Changed tiles are uploaded asynchronously: In each frame, the render thread 
+ * hands a batch of changed tiles to an upload thread, which copies them from 
+ * the cache into a mapped pixel buffer. In one of the next frames, the render 
+ * thread uploads the whole batch from the pixel buffer into the texture, with 
+ * horizontally adjacent tiles combined into a single upload.
+ *
+ * Dirty tiles are updated while they are copied, but only until the time 
+ * budget of the batch is used up. The remaining tiles are updated by the 
+ * background thread of the cache, and show their previous content until then.
+ *
+ * The size of the tiles is a template parameter, instances for the sizes 
+ * compiled with TilesCache are compiled with TorusTexture.cpp. TorusTexture is 
+ * the instance for YANTA_TILE_SIZE.
  */
-class TorusTexture {
+template <unsigned int Size>
+class BasicTorusTexture {
 
 public:
 
@@ -35,9 +57,9 @@ public:
 	 * Create a torus texture covering and representing at least the given 
 	 * region.
 	 */
-	TorusTexture(const util::box<int,2>& region);
+	BasicTorusTexture(const util::box<int,2>& region);
 
-	~TorusTexture();
+	~BasicTorusTexture();
 
 	/**
 	 * Reset the texture to represent the area around pixel 'center'.
@@ -50,13 +72,29 @@ public:
 	void shift(const util::point<int,2>& shift);
 
 	/**
-	 * Mark a region of the texture as dirty.
+	 * Tell the texture that the scale of the content changed by the given 
+	 * ratio around anchor (in pixels), i.e., that the content shown at pixel p 
+	 * is now at anchor + (p - anchor)*ratio. The rasterizer has to draw with 
+	 * the new scale already.
+	 *
+	 * The texture is reset for the new scale, but keeps showing its current 
+	 * content, scaled by the ratio, as a backdrop behind the new tiles until 
+	 * all visible tiles are available again. Consecutive calls (like during a 
+	 * pinch gesture) keep the last complete content as the backdrop.
+	 */
+	void zoom(double ratio, const util::point<int,2>& anchor);
+
+	/**
+	 * Mark a region of the texture as dirty. Only the pixels in region will be 
+	 * redrawn.
 	 */
 	void markDirty(const util::box<int,2>& region, DirtyFlag dirtyFlag);
 
 	/**
 	 * Render the content of the texture for region into region. If parts of the 
-	 * texture are dirty, they will be updated using the provided painter.
+	 * texture are dirty, they will be updated using the provided painter. The 
+	 * painter is used by the upload thread until the next call to render(), it 
+	 * has to stay valid until then.
 	 */
 	void render(const util::box<int,2>& region, Rasterizer& rasterizer);
 
@@ -65,28 +103,103 @@ public:
 	 */
 	void setBackgroundRasterizer(std::shared_ptr<Rasterizer> rasterizer);
 
+	/**
+	 * Set a governor to report the time it takes to rasterize tiles to.
+	 */
+	void setQualityGovernor(std::shared_ptr<QualityGovernor> governor) { _cache.setQualityGovernor(governor); }
+
 private:
 
+	// a tile to upload to the texture
+	struct Upload {
+
+		// the logical and physical coordinates of the tile
+		util::point<int,2> tile;
+		util::point<int,2> physicalTile;
+
+		// the offset (in pixels) of the run of horizontally adjacent tiles this 
+		// tile is part of in the pixel buffer, the number of tiles in the run, 
+		// and the position of this tile in the run
+		std::size_t  runOffset;
+		unsigned int runLength;
+		unsigned int runPosition;
+
+		// does the texture need this tile? false, if the tile shows what the 
+		// texture shows already
+		bool needed;
+
+		// was the tile ready in the cache?
+		bool done;
+	};
+
 	/**
 	 * Get all tiles intersecting the given region.
 	 */
 	util::box<int,2> getTiles(const util::box<int,2>& region);
 
 	/**
-	 * Get the tile coordinate of a pixel coordinate.
+	 * Mark a tile in logical coordinates as dirty. Only the part of the tile 
+	 * that intersects region (in pixels) needs to be redrawn.
+	 */
+	void markDirty(const util::point<int,2>& tile, DirtyFlag dirtyFlag, const util::box<int,2>& region);
+
+	/**
+	 * Mark a tile in logical coordinates as out-of-date in the texture and 
+	 * queue it for upload, unless it is queued already. If force is set, the 
+	 * tile is queued in any case.
+	 */
+	void markOutOfDate(const util::point<int,2>& tile, bool force = false);
+
+	/**
+	 * Mark all tiles out-of-date that the cache reported as changed.
+	 */
+	void processCacheChanges();
+
+	/**
+	 * Hand pending tiles to the upload thread, at most _maxUploads of them. 
+	 * Tiles in the given region are preferred.
+	 */
+	void startUploads(const util::box<int,2>& tiles, Rasterizer& rasterizer);
+
+	/**
+	 * If the upload thread finished copying the current batch, upload it to 
+	 * the texture. Does not block.
+	 */
+	void finishUploads();
+
+	/**
+	 * Wait for the upload thread and drop the current batch. The tiles of the 
+	 * batch are marked out-of-date again.
 	 */
-	int getTileCoordinate(int pixel);
+	void discardUploads();
 
 	/**
-	 * Mark a tile in logical coordinates as dirty.
+	 * Entry point of the upload thread.
 	 */
-	void markDirty(const util::point<int,2>& tile, DirtyFlag dirtyFlag);
+	void copyTiles();
 
 	/**
-	 * Try to reload a tile. Returns false, if the tile is not present in the 
-	 * cache, yet.
+	 * Copy a tile into the pixel buffer for the given upload. Called by the 
+	 * upload thread. If mayRasterize is false, dirty tiles are not updated, 
+	 * but copied with their previous content.
 	 */
-	bool reloadTile(const util::point<int,2>& tile, const util::point<int,2>& physicalTile, Rasterizer& rasterizer);
+	void copyTile(Upload& upload, Rasterizer& rasterizer, bool mayRasterize);
+
+	/**
+	 * Rebuild the quads to draw the given tiles. While there is a backdrop, 
+	 * only tiles that show their content are drawn.
+	 */
+	void updateQuads(const util::box<int,2>& tiles);
+
+	/**
+	 * Add a quad for each of the given tiles that shows its content.
+	 */
+	void addShownTiles(QuadBatch& quads, const util::box<int,2>& tiles);
+
+	/**
+	 * Check whether all of the given tiles show their content.
+	 */
+	bool allShown(const util::box<int,2>& tiles);
 
 	/**
 	 * Callback for the tiles cache.
@@ -100,8 +213,9 @@ private:
 	// come from a cache. Almost all operations are performed with respect to 
 	// these tiles (like remembering dirty regions).
 
-	// the size of the tiles the buffer provides
-	static const unsigned int TileSize = TilesCache::TileSize;
+	// the cache the tiles come from and the size of its tiles
+	typedef BasicTilesCache<Size> cache_type;
+	static const unsigned int TileSize = Size;
 
 	// the width and height of the texture in tiles
 	unsigned int _width;
@@ -111,18 +225,92 @@ private:
 	typedef boost::multi_array<bool, 2> out_of_dates_type;
 	out_of_dates_type _outOfDates;
 
+	// the out-of-date tiles in logical coordinates, waiting to be uploaded
+	std::vector<util::point<int,2>> _pendingTiles;
+
+	// 2D array of the shared buffers of uniform tiles, as they were last 
+	// uploaded to the texture (0 if the tile shows something else)
+	typedef boost::multi_array<const sg_gui::skia_pixel_t*, 2> uploaded_uniforms_type;
+	uploaded_uniforms_type _uploadedUniforms;
+
 	// mapping from logical tile coordinats to phsical tile coordinates
 	torus_mapping<int> _mapping;
 
 	// the cache to get tiles from
-	TilesCache _cache;
+	cache_type _cache;
 
 	// the actual OpenGl texture
 	sg_gui::Texture* _texture;
 
+	// the quads to draw the visible part of the texture, and the visible tiles 
+	// and their physical upper left tile they were built for
+	std::unique_ptr<QuadBatch> _quads;
+	util::box<int,2>           _quadTiles;
+	util::point<int,2>         _quadPhysicalUpperLeft;
+
+	// do the quads need to be rebuilt, even if the visible tiles didn't change?
+	bool _quadsChanged;
+
+	// 2D array of flags for the physical tiles that show their content in the 
+	// texture (i.e., that were uploaded at least once since the last reset)
+	typedef boost::multi_array<bool, 2> shown_type;
+	shown_type _shown;
+
+	// the content of the texture before a zoom, shown scaled behind the tiles 
+	// until they are available
+	sg_gui::Texture*           _backdropTexture;
+	std::unique_ptr<QuadBatch> _backdropQuads;
+	bool                       _haveBackdrop;
+
+	// the transformation from pixels of the backdrop to pixels of the texture
+	double                _backdropScale;
+	util::point<double,2> _backdropOffset;
+
 	// the image to show for tiles that haven't been rendered, yet
 	sg_gui::skia_pixel_t _notDoneImage[TileSize*TileSize];
+
+	// the current batch of uploads
+	std::vector<Upload> _uploads;
+
+	// is there a batch of uploads and did the upload thread finish copying it?
+	bool _haveUploads;
+	bool _uploadsCopied;
+
+	// the memory of the pixel buffer for the current batch
+	sg_gui::skia_pixel_t* _uploadMemory;
+
+	// the rasterizer to use for the current batch
+	Rasterizer* _uploadRasterizer;
+
+	// the target quality of the rasterizer, as last read by render() between 
+	// two batches of uploads
+	Quality _targetQuality;
+
+	// the maximal number of tiles to upload per frame
+	unsigned int _maxUploads;
+
+	// the maximal time in seconds to spend on updating dirty tiles per batch 
+	// of uploads
+	double _rasterizationBudget;
+
+	// ring of pixel buffers to upload from
+	std::unique_ptr<PixelBufferRing> _pixelBuffers;
+
+	// synchronization with the upload thread
+	boost::mutex              _uploadMutex;
+	boost::condition_variable _uploadCondition;
+	bool                      _stopUploadThread;
+
+	// copies tiles from the cache into pixel buffers
+	boost::thread _uploadThread;
 };
 
+extern template class BasicTorusTexture<64>;
+extern template class BasicTorusTexture<128>;
+extern template class BasicTorusTexture<256>;
+extern template class BasicTorusTexture<512>;
+
+typedef BasicTorusTexture<YANTA_TILE_SIZE> TorusTexture;
+
 #endif // YANTA_GUI_TORUS_TEXTURE_H__
 
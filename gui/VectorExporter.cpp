@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include <SkDocument.h>
+
+#include <document/DocumentTreeRoiVisitor.h>
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include "StrokeOutline.h"
+#include "VectorExporter.h"
+
+logger::LogChannel vectorexporterlog("vectorexporterlog", "[VectorExporter] ");
+
+util::ProgramOption optionExportTolerance(
+		util::_long_name        = "exportTolerance",
+		util::_description_text = "The distance (in millimeters) below which samples of a stroke are merged in vector exports.",
+		util::_default_value    = 0.05);
+
+// defined in OffscreenRenderer.cpp
+extern util::ProgramOption optionRenderThreads;
+
+namespace {
+
+// the number of points per millimeter in PDF
+const double pointsPerUnit = 72.0/25.4;
+
+} // anonymous namespace
+
+/**
+ * Collects the outlines of the strokes of a page.
+ */
+class VectorExporter::ContentVisitor : public DocumentTreeRoiVisitor {
+
+public:
+
+	ContentVisitor(const StrokePoints& strokePoints, double tolerance, std::vector<Shape>& shapes) :
+		_strokePoints(strokePoints),
+		_tolerance(tolerance),
+		_shapes(shapes) {}
+
+	/**
+	 * Selections are not exported.
+	 */
+	template <typename VisitorType>
+	void traverse(Selection&, VisitorType&) {}
+
+	// other business as usual
+	using DocumentTreeRoiVisitor::traverse;
+
+	void visit(Stroke& stroke) {
+
+		// the tolerance is in document units, the outline is created in the 
+		// coordinates of the stroke
+		util::point<DocumentPrecision,2> scale = getTransformation().getScale();
+		double strokeTolerance = _tolerance/std::max(std::abs(scale.x()), std::abs(scale.y()));
+
+		_outline.create(_strokePoints, stroke, strokeTolerance);
+
+		if (_outline.getPolygon().empty())
+			return;
+
+		_shapes.push_back(Shape());
+		Shape& shape = _shapes.back();
+
+		shape.red   = stroke.getStyle().getRed();
+		shape.green = stroke.getStyle().getGreen();
+		shape.blue  = stroke.getStyle().getBlue();
+		shape.alpha = stroke.getStyle().getAlpha();
+
+		// bring the outline into document coordinates
+		shape.polygon.reserve(_outline.getPolygon().size());
+		for (const util::point<double,2>& corner : _outline.getPolygon())
+			shape.polygon.push_back(getTransformation().applyTo(corner));
+	}
+
+	// default callbacks
+	using DocumentTreeRoiVisitor::visit;
+
+private:
+
+	const StrokePoints& _strokePoints;
+	double              _tolerance;
+	std::vector<Shape>& _shapes;
+	StrokeOutline       _outline;
+};
+
+/**
+ * Interface for the output formats.
+ */
+class VectorExporter::PageWriter {
+
+public:
+
+	virtual ~PageWriter() {}
+
+	/**
+	 * Write a page. Returns false on errors.
+	 */
+	virtual bool writePage(const PageContent& content) = 0;
+
+	/**
+	 * Finish the output after the last page. Returns false on errors.
+	 */
+	virtual bool finish() = 0;
+};
+
+/**
+ * Writes one PDF page per document page through Skia's PDF backend.
+ */
+class VectorExporter::PdfWriter : public VectorExporter::PageWriter {
+
+public:
+
+	PdfWriter(const std::string& filename) :
+		_document(SkDocument::MakePDF(filename.c_str())) {
+
+		if (!_document)
+			LOG_ERROR(vectorexporterlog) << "could not create PDF document " << filename << std::endl;
+	}
+
+	bool writePage(const PageContent& content) {
+
+		if (!_document)
+			return false;
+
+		SkCanvas* canvas = _document->beginPage(
+				content.boundingBox.width()*pointsPerUnit,
+				content.boundingBox.height()*pointsPerUnit);
+
+		// draw in millimeters relative to the upper left of the page
+		canvas->scale(pointsPerUnit, pointsPerUnit);
+		canvas->translate(-content.boundingBox.min().x(), -content.boundingBox.min().y());
+
+		SkPaint paint;
+		paint.setStyle(SkPaint::kFill_Style);
+		paint.setAntiAlias(true);
+
+		// the paper, as in the SVG output
+		paint.setColor(SkColorSetRGB(255, 255, 255));
+		canvas->drawRect(
+				SkRect::MakeLTRB(
+						content.boundingBox.min().x(),
+						content.boundingBox.min().y(),
+						content.boundingBox.max().x(),
+						content.boundingBox.max().y()),
+				paint);
+
+		SkPath path;
+
+		for (const Shape& shape : content.shapes) {
+
+			path.rewind();
+			path.moveTo(shape.polygon[0].x(), shape.polygon[0].y());
+			for (unsigned int i = 1; i < shape.polygon.size(); i++)
+				path.lineTo(shape.polygon[i].x(), shape.polygon[i].y());
+			path.close();
+
+			paint.setColor(SkColorSetARGB(shape.alpha, shape.red, shape.green, shape.blue));
+			canvas->drawPath(path, paint);
+		}
+
+		_document->endPage();
+
+		return true;
+	}
+
+	bool finish() {
+
+		if (!_document)
+			return false;
+
+		_document->close();
+
+		return true;
+	}
+
+private:
+
+	sk_sp<SkDocument> _document;
+};
+
+/**
+ * Writes all pages into a single SVG image, each page as a group at its 
+ * position in the document.
+ */
+class VectorExporter::SvgWriter : public VectorExporter::PageWriter {
+
+public:
+
+	SvgWriter(const std::string& filename, const util::box<DocumentPrecision,2>& boundingBox) :
+		_out(filename.c_str()) {
+
+		if (!_out) {
+
+			LOG_ERROR(vectorexporterlog) << "could not open " << filename << std::endl;
+			return;
+		}
+
+		_out << std::fixed << std::setprecision(3);
+
+		_out
+				<< "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl
+				<< "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\""
+				<< " width=\"" << boundingBox.width() << "mm\""
+				<< " height=\"" << boundingBox.height() << "mm\""
+				<< " viewBox=\""
+				<< boundingBox.min().x() << " " << boundingBox.min().y() << " "
+				<< boundingBox.width() << " " << boundingBox.height() << "\">" << std::endl;
+	}
+
+	bool writePage(const PageContent& content) {
+
+		if (!_out)
+			return false;
+
+		_out << "<g>" << std::endl;
+
+		_out
+				<< "<rect fill=\"#ffffff\""
+				<< " x=\"" << content.boundingBox.min().x() << "\""
+				<< " y=\"" << content.boundingBox.min().y() << "\""
+				<< " width=\"" << content.boundingBox.width() << "\""
+				<< " height=\"" << content.boundingBox.height() << "\"/>" << std::endl;
+
+		for (const Shape& shape : content.shapes) {
+
+			_out
+					<< "<path fill=\"#"
+					<< std::hex << std::setfill('0')
+					<< std::setw(2) << static_cast<int>(shape.red)
+					<< std::setw(2) << static_cast<int>(shape.green)
+					<< std::setw(2) << static_cast<int>(shape.blue)
+					<< std::dec << std::setfill(' ') << "\"";
+
+			if (shape.alpha != 255)
+				_out << " fill-opacity=\"" << shape.alpha/255.0 << "\"";
+
+			_out << " d=\"M";
+			for (const util::point<double,2>& corner : shape.polygon)
+				_out << " " << corner.x() << " " << corner.y();
+			_out << " Z\"/>" << std::endl;
+		}
+
+		_out << "</g>" << std::endl;
+
+		return static_cast<bool>(_out);
+	}
+
+	bool finish() {
+
+		if (!_out)
+			return false;
+
+		_out << "</svg>" << std::endl;
+		_out.close();
+
+		return !_out.fail();
+	}
+
+private:
+
+	std::ofstream _out;
+};
+
+VectorExporter::VectorExporter(std::shared_ptr<Document> document, unsigned int numThreads) :
+	_document(document),
+	_numThreads(numThreads),
+	_tolerance(optionExportTolerance.as<double>()),
+	_window(0),
+	_nextPage(0),
+	_nextToWrite(0),
+	_abort(false) {
+
+	if (_numThreads == 0)
+		_numThreads = optionRenderThreads.as<unsigned int>();
+
+	if (_numThreads == 0)
+		_numThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+}
+
+bool
+VectorExporter::exportDocument(const std::string& filename, Format format) {
+
+	unsigned int numPages = _document->numPages();
+
+	LOG_DEBUG(vectorexporterlog) << "exporting " << numPages << " pages to " << filename << std::endl;
+
+	std::unique_ptr<PageWriter> writer;
+
+	if (format == Pdf) {
+
+		writer.reset(new PdfWriter(filename));
+
+	} else {
+
+		// the SVG image covers all pages
+		util::box<DocumentPrecision,2> boundingBox(0, 0, 0, 0);
+
+		for (unsigned int i = 0; i < numPages; i++) {
+
+			const util::box<DocumentPrecision,2>& pageBox = _document->getPage(i).getPageBoundingBox();
+
+			if (i == 0) {
+
+				boundingBox = pageBox;
+
+			} else {
+
+				boundingBox.min().x() = std::min(boundingBox.min().x(), pageBox.min().x());
+				boundingBox.min().y() = std::min(boundingBox.min().y(), pageBox.min().y());
+				boundingBox.max().x() = std::max(boundingBox.max().x(), pageBox.max().x());
+				boundingBox.max().y() = std::max(boundingBox.max().y(), pageBox.max().y());
+			}
+		}
+
+		writer.reset(new SvgWriter(filename, boundingBox));
+	}
+
+	// two pages per thread keep the threads busy while a page is written
+	_window      = 2*_numThreads;
+	_nextPage    = 0;
+	_nextToWrite = 0;
+	_abort       = false;
+	_slots.clear();
+	_slots.resize(_window);
+	for (PageContent& slot : _slots)
+		slot.done = false;
+
+	boost::thread_group threads;
+	for (unsigned int i = 0; i < std::min(_numThreads, numPages); i++)
+		threads.create_thread(boost::bind(&VectorExporter::createPages, this));
+
+	bool success = true;
+
+	for (unsigned int page = 0; page < numPages; page++) {
+
+		PageContent& content = _slots[page%_window];
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			while (!content.done)
+				_pageDone.wait(lock);
+		}
+
+		LOG_DEBUG(vectorexporterlog) << "writing page " << page << " with " << content.shapes.size() << " shapes" << std::endl;
+
+		// the workers don't touch the slot until we free it
+		success = writer->writePage(content);
+
+		{
+			boost::lock_guard<boost::mutex> lock(_mutex);
+
+			content.done = false;
+			content.shapes.clear();
+			_nextToWrite++;
+
+			if (!success)
+				_abort = true;
+		}
+
+		_slotFree.notify_all();
+
+		if (!success)
+			break;
+	}
+
+	threads.join_all();
+
+	_slots.clear();
+
+	if (success)
+		success = writer->finish();
+
+	if (!success)
+		LOG_ERROR(vectorexporterlog) << "could not write " << filename << std::endl;
+
+	return success;
+}
+
+void
+VectorExporter::createPages() {
+
+	unsigned int numPages = _document->numPages();
+
+	while (true) {
+
+		unsigned int page;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			// wait for a free slot
+			while (!_abort && _nextPage < numPages && _nextPage >= _nextToWrite + _window)
+				_slotFree.wait(lock);
+
+			if (_abort || _nextPage >= numPages)
+				return;
+
+			page = _nextPage++;
+		}
+
+		PageContent& content = _slots[page%_window];
+
+		createPage(page, content);
+
+		{
+			boost::lock_guard<boost::mutex> lock(_mutex);
+			content.done = true;
+		}
+
+		_pageDone.notify_all();
+	}
+}
+
+void
+VectorExporter::createPage(unsigned int page, PageContent& content) {
+
+	LOG_ALL(vectorexporterlog) << "creating page " << page << std::endl;
+
+	Page& p = _document->getPage(page);
+
+	content.boundingBox = p.getPageBoundingBox();
+
+	ContentVisitor visitor(_document->getStrokePoints(), _tolerance, content.shapes);
+
+	// only strokes on the paper are exported
+	visitor.setRoi(content.boundingBox);
+
+	// make sure reading access to the stroke points is safe
+	boost::shared_lock<boost::shared_mutex> lock(_document->getStrokePoints().getMutex());
+
+	p.accept(visitor);
+}
+
@@ -0,0 +1,117 @@
+#ifndef YANTA_GUI_VECTOR_EXPORTER_H__
+#define YANTA_GUI_VECTOR_EXPORTER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <util/box.hpp>
+#include <util/point.hpp>
+#include <document/Document.h>
+
+/**
+ * Exports the pages of a document to PDF or SVG. Strokes are written as 
+ * filled outlines (see StrokeOutline), simplified to a tolerance that keeps 
+ * the output size bounded.
+ *
+ * The outlines of the pages are created in parallel, but the pages are 
+ * written in order as soon as they are ready. At most a fixed window of pages 
+ * is held in memory at any time, independent of the size of the document.
+ */
+class VectorExporter {
+
+public:
+
+	enum Format {
+
+		Pdf,
+
+		Svg
+	};
+
+	/**
+	 * Create an exporter for the given document that uses numThreads threads 
+	 * to create the pages. If numThreads is zero, the number of threads is 
+	 * given by the program option 'renderThreads', or the number of cores if 
+	 * that is zero as well.
+	 */
+	VectorExporter(std::shared_ptr<Document> document, unsigned int numThreads = 0);
+
+	/**
+	 * Set the distance in document units below which samples of a stroke are 
+	 * merged. The default is given by the program option 'exportTolerance'.
+	 */
+	void setTolerance(double tolerance) { _tolerance = tolerance; }
+
+	/**
+	 * Export all pages of the document to the given file.
+	 *
+	 * @return false, if the file could not be written.
+	 */
+	bool exportDocument(const std::string& filename, Format format);
+
+private:
+
+	// a filled polygon in document coordinates
+	struct Shape {
+
+		std::vector<util::point<double,2>> polygon;
+		unsigned char red, green, blue, alpha;
+	};
+
+	// the content of one page, ready to be written
+	struct PageContent {
+
+		util::box<DocumentPrecision,2> boundingBox;
+		std::vector<Shape>             shapes;
+
+		// was the content created already?
+		bool done;
+	};
+
+	// creates the content of a page
+	class ContentVisitor;
+
+	// writers for the supported formats
+	class PageWriter;
+	class PdfWriter;
+	class SvgWriter;
+
+	/**
+	 * Entry point of the worker threads. Creates the content of pages until 
+	 * there are none left.
+	 */
+	void createPages();
+
+	/**
+	 * Create the content of a single page.
+	 */
+	void createPage(unsigned int page, PageContent& content);
+
+	std::shared_ptr<Document> _document;
+
+	unsigned int _numThreads;
+
+	double _tolerance;
+
+	// the pages being created or waiting to be written, page i is in slot 
+	// i%_window
+	std::vector<PageContent> _slots;
+	unsigned int             _window;
+
+	// the next page to create and to write
+	unsigned int _nextPage;
+	unsigned int _nextToWrite;
+
+	// stop creating pages
+	bool _abort;
+
+	boost::mutex              _mutex;
+	boost::condition_variable _pageDone;
+	boost::condition_variable _slotFree;
+};
+
+#endif // YANTA_GUI_VECTOR_EXPORTER_H__
+
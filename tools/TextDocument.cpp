@@ -0,0 +1,115 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "TextDocument.h"
+
+std::shared_ptr<Document>
+readTextDocument(const std::string& filename) {
+
+	std::ifstream in(filename.c_str());
+
+	if (!in) {
+
+		std::cerr << "could not open " << filename << std::endl;
+		return std::shared_ptr<Document>();
+	}
+
+	auto document = std::make_shared<Document>();
+
+	Style style;
+	bool  haveStroke = false;
+
+	std::string line;
+	while (std::getline(in, line)) {
+
+		if (line.empty()) {
+
+			if (haveStroke)
+				document->finishCurrentStroke();
+			haveStroke = false;
+
+			continue;
+		}
+
+		if (line[0] == '#')
+			continue;
+
+		std::istringstream tokens(line);
+
+		if (line.compare(0, 4, "page") == 0) {
+
+			std::string keyword;
+			double x, y, width, height;
+
+			if (!(tokens >> keyword >> x >> y >> width >> height)) {
+
+				std::cerr << "skipping malformed line '" << line << "' in " << filename << std::endl;
+				continue;
+			}
+
+			if (haveStroke)
+				document->finishCurrentStroke();
+			haveStroke = false;
+
+			document->createPage(util::point<DocumentPrecision,2>(x, y), util::point<PagePrecision,2>(width, height));
+
+		} else if (line.compare(0, 6, "stroke") == 0) {
+
+			std::string keyword;
+			double width;
+			int red, green, blue, alpha = 255;
+
+			if (!(tokens >> keyword >> width >> red >> green >> blue)) {
+
+				std::cerr << "skipping malformed line '" << line << "' in " << filename << std::endl;
+				continue;
+			}
+
+			tokens >> alpha;
+
+			if (haveStroke)
+				document->finishCurrentStroke();
+			haveStroke = false;
+
+			style.setWidth(width);
+			style.setColor(red, green, blue, alpha);
+
+		} else {
+
+			double x, y, pressure;
+			unsigned long timestamp;
+
+			if (!(tokens >> x >> y >> pressure >> timestamp)) {
+
+				std::cerr << "skipping malformed line '" << line << "' in " << filename << std::endl;
+				continue;
+			}
+
+			if (document->numPages() == 0) {
+
+				std::cerr << "sample before the first page in " << filename << std::endl;
+				return std::shared_ptr<Document>();
+			}
+
+			util::point<DocumentPrecision,2> position(x, y);
+
+			if (!haveStroke) {
+
+				document->createNewStroke(position, pressure, timestamp);
+				document->setCurrentStrokeStyle(style);
+				haveStroke = true;
+
+			} else {
+
+				document->addStrokePoint(position, pressure, timestamp);
+			}
+		}
+	}
+
+	if (haveStroke)
+		document->finishCurrentStroke();
+
+	return document;
+}
+
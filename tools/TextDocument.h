@@ -0,0 +1,28 @@
+#ifndef YANTA_TOOLS_TEXT_DOCUMENT_H__
+#define YANTA_TOOLS_TEXT_DOCUMENT_H__
+
+#include <memory>
+#include <string>
+
+#include <document/Document.h>
+
+/**
+ * Read a document from a plain text file, as used by the command line tools. 
+ * The file consists of lines
+ *
+ *   page <x> <y> <width> <height>
+ *   stroke <width> <red> <green> <blue> [<alpha>]
+ *   <x> <y> <pressure> <timestamp>
+ *
+ * where 'page' creates a page at the given position, 'stroke' starts a new 
+ * stroke with the given style, and all other lines add a sample to the 
+ * current stroke. Positions and sizes are in document units (millimeters), 
+ * timestamps in milliseconds. Empty lines finish the current stroke, lines 
+ * starting with '#' are ignored.
+ *
+ * Returns an empty pointer if the file could not be read.
+ */
+std::shared_ptr<Document> readTextDocument(const std::string& filename);
+
+#endif // YANTA_TOOLS_TEXT_DOCUMENT_H__
+
@@ -0,0 +1,254 @@
+/**
+ * Benchmark of the tile sizes the tiles cache can be compiled with. For each 
+ * size, a viewport at the upper left of the first page of a document is 
+ * rasterized into a tiles cache, first completely and then once for each 
+ * stroke of the document, as if the stroke was just added.
+ *
+ * Larger tiles cost more when only a small part of the document changes 
+ * (everything in the tiles a change touches is redrawn), smaller tiles cost 
+ * more for each rasterized pixel (each tile has to visit the document again). 
+ * The report lists both for each tile size, to choose the TILE_SIZE for a 
+ * deployment. The document is read from a plain text file (see 
+ * TextDocument.h).
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <boost/timer/timer.hpp>
+
+#include <gui/OffscreenRenderer.h>
+#include <gui/SkiaDocumentPainter.h>
+#include <gui/TilesCache.h>
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include <util/exceptions.h>
+#include "TextDocument.h"
+
+util::ProgramOption optionDocument(
+		util::_long_name        = "document",
+		util::_description_text = "The document to rasterize.");
+
+util::ProgramOption optionDpi(
+		util::_long_name        = "dpi",
+		util::_description_text = "The resolution to rasterize with in dots per inch.",
+		util::_default_value    = 150);
+
+util::ProgramOption optionViewport(
+		util::_long_name        = "viewport",
+		util::_description_text = "The size \"width height\" of the viewport in pixels.",
+		util::_default_value    = "1920 1080");
+
+util::ProgramOption optionRepetitions(
+		util::_long_name        = "repetitions",
+		util::_description_text = "The number of times to repeat each measurement, the fastest one is reported.",
+		util::_default_value    = 3);
+
+/**
+ * Get the tiles of the given size that cover a region in pixels.
+ */
+template <unsigned int Size>
+util::box<int,2>
+getTiles(const util::box<int,2>& region) {
+
+	typedef BasicTilesCache<Size> cache_type;
+
+	return util::box<int,2>(
+			cache_type::getTileCoordinate(region.min().x()),
+			cache_type::getTileCoordinate(region.min().y()),
+			cache_type::getTileCoordinate(region.max().x() - 1) + 1,
+			cache_type::getTileCoordinate(region.max().y() - 1) + 1);
+}
+
+/**
+ * Get all tiles in the given region, such that they are up-to-date.
+ */
+template <unsigned int Size>
+void
+getTiles(BasicTilesCache<Size>& cache, const util::box<int,2>& tiles, Rasterizer& rasterizer) {
+
+	for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+		for (int y = tiles.min().y(); y < tiles.max().y(); y++)
+			cache.releaseTile(cache.getTile(util::point<int,2>(x, y), rasterizer));
+}
+
+template <unsigned int Size>
+void
+benchmark(
+		std::shared_ptr<Document> document,
+		double pixelsPerUnit,
+		const util::box<int,2>& viewport,
+		const std::vector<util::box<int,2>>& changes,
+		unsigned int repetitions) {
+
+	typedef BasicTilesCache<Size> cache_type;
+
+	util::box<int,2> viewportTiles = getTiles<Size>(viewport);
+
+	// the cache has to contain the viewport and keep all of it in memory
+	unsigned int width  = viewportTiles.width()  + 2;
+	unsigned int height = viewportTiles.height() + 2;
+
+	double fullTime   = 0;
+	double changeTime = 0;
+
+	unsigned long changedTiles  = 0;
+	unsigned long changedPixels = 0;
+
+	for (unsigned int r = 0; r < repetitions; r++) {
+
+		SkiaDocumentPainter painter;
+		painter.setDocument(document);
+		painter.setDeviceTransformation(util::point<double,2>(pixelsPerUnit, pixelsPerUnit), util::point<int,2>(0, 0));
+
+		cache_type cache(width, height, width*height, viewportTiles.center());
+
+		boost::timer::cpu_timer fullTimer;
+		getTiles(cache, viewportTiles, painter);
+		double full = fullTimer.elapsed().wall*1e-9;
+
+		changedTiles  = 0;
+		changedPixels = 0;
+
+		boost::timer::cpu_timer changeTimer;
+
+		for (unsigned int i = 0; i < changes.size(); i++) {
+
+			util::box<int,2> tiles = getTiles<Size>(changes[i]);
+
+			for (int x = tiles.min().x(); x < tiles.max().x(); x++)
+				for (int y = tiles.min().y(); y < tiles.max().y(); y++)
+					cache.markDirty(util::point<int,2>(x, y), cache_type::NeedsRedraw, changes[i]);
+
+			getTiles(cache, tiles, painter);
+
+			changedTiles  += tiles.area();
+			changedPixels += changes[i].area();
+		}
+
+		double change = changeTimer.elapsed().wall*1e-9;
+
+		if (r == 0 || full < fullTime)
+			fullTime = full;
+		if (r == 0 || change < changeTime)
+			changeTime = change;
+	}
+
+	// the number of rasterized pixels per pixel of the viewport
+	double fullOverhead = static_cast<double>(viewportTiles.area())*Size*Size/viewport.area();
+
+	std::cout
+			<< std::setw(10) << Size
+			<< std::setw(10) << viewportTiles.area()
+			<< std::setw(14) << std::fixed << std::setprecision(2) << fullTime*1e3
+			<< std::setw(14) << std::setprecision(3) << fullTime*1e9/(static_cast<double>(viewportTiles.area())*Size*Size)
+			<< std::setw(12) << std::setprecision(2) << fullOverhead;
+
+	if (changes.empty()) {
+
+		std::cout << std::endl;
+		return;
+	}
+
+	std::cout
+			<< std::setw(14) << std::setprecision(2) << static_cast<double>(changedTiles)/changes.size()
+			<< std::setw(14) << std::setprecision(3) << changeTime*1e3/changes.size()
+			<< std::setw(14) << std::setprecision(2) << static_cast<double>(changedTiles)*Size*Size/changedPixels
+			<< std::endl;
+}
+
+int main(int argc, char** argv) {
+
+	try {
+
+		util::ProgramOptions::init(argc, argv);
+		logger::LogManager::init();
+
+		if (!optionDocument) {
+
+			std::cerr << "usage: " << argv[0] << " --document <file> [--dpi <dpi>] [--viewport \"width height\"] [--repetitions <n>]" << std::endl;
+			return 1;
+		}
+
+		std::shared_ptr<Document> document = readTextDocument(optionDocument.as<std::string>());
+
+		if (!document)
+			return 1;
+
+		if (document->numPages() == 0) {
+
+			std::cerr << "the document has no pages" << std::endl;
+			return 1;
+		}
+
+		// one document unit is one millimeter
+		double pixelsPerUnit = optionDpi.as<double>()/25.4;
+
+		std::istringstream values(optionViewport.as<std::string>());
+		int viewportWidth, viewportHeight;
+
+		if (!(values >> viewportWidth >> viewportHeight) || viewportWidth <= 0 || viewportHeight <= 0) {
+
+			std::cerr << "invalid viewport '" << optionViewport.as<std::string>() << "'" << std::endl;
+			return 1;
+		}
+
+		// the viewport starts at the upper left of the first page
+		util::box<int,2> firstPage = OffscreenRenderer::getPixelRegion(document->getPage(0).getPageBoundingBox(), pixelsPerUnit);
+		util::box<int,2> viewport(
+				firstPage.min().x(),
+				firstPage.min().y(),
+				firstPage.min().x() + viewportWidth,
+				firstPage.min().y() + viewportHeight);
+
+		// the strokes in the viewport, each of them is one change
+		std::vector<util::box<int,2>> changes;
+
+		for (unsigned int i = 0; i < document->numPages(); i++) {
+
+			const Page& page = document->getPage(i);
+
+			for (unsigned int j = 0; j < page.numStrokes(); j++) {
+
+				util::box<DocumentPrecision,2> strokeBoundingBox = page.getStroke(j).getBoundingBox()*page.getScale() + page.getShift();
+				util::box<int,2>               change = OffscreenRenderer::getPixelRegion(strokeBoundingBox, pixelsPerUnit).intersection(viewport);
+
+				if (change.area() > 0)
+					changes.push_back(change);
+			}
+		}
+
+		unsigned int repetitions = std::max(optionRepetitions.as<unsigned int>(), 1u);
+
+		std::cout
+				<< "viewport of " << viewport.width() << "x" << viewport.height() << " pixels, "
+				<< changes.size() << " changes, best of " << repetitions << " runs" << std::endl << std::endl;
+
+		std::cout
+				<< std::setw(10) << "tile size"
+				<< std::setw(10) << "tiles"
+				<< std::setw(14) << "full [ms]"
+				<< std::setw(14) << "[ns/pixel]"
+				<< std::setw(12) << "overdraw"
+				<< std::setw(14) << "tiles/change"
+				<< std::setw(14) << "[ms/change]"
+				<< std::setw(14) << "pixels/dirty"
+				<< std::endl;
+
+		benchmark<64> (document, pixelsPerUnit, viewport, changes, repetitions);
+		benchmark<128>(document, pixelsPerUnit, viewport, changes, repetitions);
+		benchmark<256>(document, pixelsPerUnit, viewport, changes, repetitions);
+		benchmark<512>(document, pixelsPerUnit, viewport, changes, repetitions);
+
+		return 0;
+
+	} catch (boost::exception& e) {
+
+		handleException(e, std::cerr);
+		return 1;
+	}
+}
+
@@ -0,0 +1,187 @@
+/**
+ * Offline evaluation of the ink prediction. Reads recorded pen sessions and 
+ * reports how far the predicted pen positions are off from where the pen 
+ * actually was, for several look-ahead times. As a baseline, the error of not 
+ * predicting at all (i.e., showing the last sample) is reported as well.
+ *
+ * A session is a plain text file with one sample per line:
+ *
+ *   x y pressure timestamp
+ *
+ * with timestamps in milliseconds. Strokes are separated by empty lines, lines 
+ * starting with '#' are ignored.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <document/InkPredictor.h>
+
+struct Errors {
+
+	Errors() : num(0), sum(0), sum2(0), max(0) {}
+
+	void add(double error) {
+
+		num++;
+		sum  += error;
+		sum2 += error*error;
+		max   = std::max(max, error);
+	}
+
+	double mean() const { return (num > 0 ? sum/num : 0); }
+	double rms()  const { return (num > 0 ? std::sqrt(sum2/num) : 0); }
+
+	unsigned long num;
+	double sum, sum2, max;
+};
+
+/**
+ * Read a session into points. Returns the strokes as [begin, end) ranges.
+ */
+std::vector<std::pair<unsigned long, unsigned long>>
+readSession(const std::string& filename, StrokePoints& points) {
+
+	std::vector<std::pair<unsigned long, unsigned long>> strokes;
+
+	std::ifstream in(filename.c_str());
+
+	if (!in) {
+
+		std::cerr << "could not open " << filename << std::endl;
+		return strokes;
+	}
+
+	unsigned long begin = points.size();
+	std::string line;
+
+	while (true) {
+
+		bool haveLine = static_cast<bool>(std::getline(in, line));
+
+		if (!haveLine || line.empty()) {
+
+			if (points.size() > begin)
+				strokes.push_back(std::make_pair(begin, points.size()));
+			begin = points.size();
+
+			if (!haveLine)
+				break;
+
+			continue;
+		}
+
+		if (line[0] == '#')
+			continue;
+
+		std::istringstream sample(line);
+		double x, y, pressure;
+		unsigned long timestamp;
+
+		if (!(sample >> x >> y >> pressure >> timestamp)) {
+
+			std::cerr << "skipping malformed line '" << line << "' in " << filename << std::endl;
+			continue;
+		}
+
+		points.add(StrokePoint(util::point<double,2>(x, y), pressure, timestamp));
+	}
+
+	return strokes;
+}
+
+/**
+ * Get the position of the pen at the given time, by interpolating the samples 
+ * of a stroke. Returns false, if the stroke ended before.
+ */
+bool
+positionAt(const StrokePoints& points, unsigned long begin, unsigned long end, double time, util::point<double,2>& position) {
+
+	for (unsigned long i = begin + 1; i < end; i++) {
+
+		if (points[i].timestamp < time)
+			continue;
+
+		const StrokePoint& a = points[i - 1];
+		const StrokePoint& b = points[i];
+
+		double alpha = (b.timestamp > a.timestamp ? (time - a.timestamp)/(b.timestamp - a.timestamp) : 1.0);
+		position = a.position + (b.position - a.position)*alpha;
+
+		return true;
+	}
+
+	return false;
+}
+
+inline double
+distance(const util::point<double,2>& a, const util::point<double,2>& b) {
+
+	util::point<double,2> d = a - b;
+	return std::sqrt(d.x()*d.x() + d.y()*d.y());
+}
+
+int main(int argc, char** argv) {
+
+	if (argc < 2) {
+
+		std::cerr << "usage: " << argv[0] << " <session> [<session> ...]" << std::endl;
+		return 1;
+	}
+
+	StrokePoints points;
+	std::vector<std::pair<unsigned long, unsigned long>> strokes;
+
+	for (int i = 1; i < argc; i++) {
+
+		std::vector<std::pair<unsigned long, unsigned long>> sessionStrokes = readSession(argv[i], points);
+		strokes.insert(strokes.end(), sessionStrokes.begin(), sessionStrokes.end());
+	}
+
+	std::cout << "read " << strokes.size() << " strokes with " << points.size() << " samples" << std::endl;
+	std::cout << std::endl;
+	std::cout << "look-ahead [ms]\tsamples\tbaseline mean\tbaseline rms\tmean\trms\tmax" << std::endl;
+
+	const double lookAheads[] = { 8, 16, 24, 32, 48 };
+
+	for (double lookAhead : lookAheads) {
+
+		InkPredictor predictor(lookAhead);
+
+		Errors baseline;
+		Errors predicted;
+
+		for (const auto& stroke : strokes)
+			for (unsigned long i = stroke.first + 1; i < stroke.second; i++) {
+
+				// pretend we have seen samples [first, i]
+				util::point<double,2> truth;
+				if (!positionAt(points, stroke.first, stroke.second, points[i].timestamp + lookAhead, truth))
+					break;
+
+				StrokePoint prediction(util::point<double,2>(0, 0), 0, 0);
+				if (!predictor.predict(points, stroke.first, i + 1, lookAhead, prediction))
+					continue;
+
+				baseline.add(distance(points[i].position, truth));
+				predicted.add(distance(prediction.position, truth));
+			}
+
+		std::cout
+				<< lookAhead << "\t"
+				<< predicted.num << "\t"
+				<< baseline.mean() << "\t"
+				<< baseline.rms() << "\t"
+				<< predicted.mean() << "\t"
+				<< predicted.rms() << "\t"
+				<< predicted.max << std::endl;
+	}
+
+	return 0;
+}
+
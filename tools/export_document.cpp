@@ -0,0 +1,109 @@
+/**
+ * Export a document to PDF, SVG, or PNG, without a display. The document is 
+ * read from a plain text file (see TextDocument.h), the format of the output 
+ * is given by the extension of the output file.
+ *
+ * PNG exports are rendered in bands with bounded memory, for high 
+ * resolutions. If the document has several pages, page i is written to 
+ * <output>_<i>.png.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <gui/RasterExporter.h>
+#include <gui/VectorExporter.h>
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include <util/exceptions.h>
+#include "TextDocument.h"
+
+util::ProgramOption optionDocument(
+		util::_long_name        = "document",
+		util::_description_text = "The document to export.");
+
+util::ProgramOption optionOutput(
+		util::_long_name        = "output",
+		util::_description_text = "The file to export to, ending in .pdf, .svg, or .png.");
+
+util::ProgramOption optionDpi(
+		util::_long_name        = "dpi",
+		util::_description_text = "The resolution of PNG exports in dots per inch.",
+		util::_default_value    = 600);
+
+bool
+endsWith(const std::string& s, const std::string& suffix) {
+
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+
+	try {
+
+		util::ProgramOptions::init(argc, argv);
+		logger::LogManager::init();
+
+		if (!optionDocument || !optionOutput) {
+
+			std::cerr << "usage: " << argv[0] << " --document <file> --output <file>.(pdf|svg|png) [--dpi <dpi>]" << std::endl;
+			return 1;
+		}
+
+		std::string output = optionOutput.as<std::string>();
+
+		std::shared_ptr<Document> document = readTextDocument(optionDocument.as<std::string>());
+
+		if (!document)
+			return 1;
+
+		if (endsWith(output, ".pdf") || endsWith(output, ".svg")) {
+
+			VectorExporter exporter(document);
+
+			if (!exporter.exportDocument(output, endsWith(output, ".pdf") ? VectorExporter::Pdf : VectorExporter::Svg))
+				return 1;
+
+		} else if (endsWith(output, ".png")) {
+
+			RasterExporter exporter(document);
+
+			// one document unit is one millimeter
+			double pixelsPerUnit = optionDpi.as<double>()/25.4;
+
+			std::string base = output.substr(0, output.size() - 4);
+			bool success = true;
+
+			for (unsigned int i = 0; i < document->numPages(); i++) {
+
+				std::ostringstream filename;
+
+				if (document->numPages() == 1)
+					filename << output;
+				else
+					filename << base << "_" << i << ".png";
+
+				std::cout << "exporting page " << i << " to " << filename.str() << std::endl;
+
+				success &= exporter.exportPage(i, pixelsPerUnit, filename.str());
+			}
+
+			if (!success)
+				return 1;
+
+		} else {
+
+			std::cerr << "unknown output format for " << output << std::endl;
+			return 1;
+		}
+
+		return 0;
+
+	} catch (boost::exception& e) {
+
+		handleException(e, std::cerr);
+		return 1;
+	}
+}
+
@@ -0,0 +1,133 @@
+/**
+ * Render pages or regions of a document into PNG files, without a display. 
+ * The document is read from a plain text file (see TextDocument.h).
+ *
+ * Without a region, every page is written to <output>_<page>.png. With a 
+ * region (in millimeters), the region is written to <output>.png.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <SkBitmap.h>
+#include <SkImageEncoder.h>
+
+#include <gui/OffscreenRenderer.h>
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include <util/exceptions.h>
+#include "TextDocument.h"
+
+util::ProgramOption optionDocument(
+		util::_long_name        = "document",
+		util::_description_text = "The document to render.");
+
+util::ProgramOption optionOutput(
+		util::_long_name        = "output",
+		util::_description_text = "The name of the output files, without extension.",
+		util::_default_value    = "page");
+
+util::ProgramOption optionDpi(
+		util::_long_name        = "dpi",
+		util::_description_text = "The resolution of the output in dots per inch.",
+		util::_default_value    = 150);
+
+util::ProgramOption optionRegion(
+		util::_long_name        = "region",
+		util::_description_text = "Render only the given region \"minX minY maxX maxY\" (in millimeters) instead of the pages.");
+
+bool
+renderToPng(
+		OffscreenRenderer& renderer,
+		const util::box<DocumentPrecision,2>& region,
+		double pixelsPerUnit,
+		const std::string& filename) {
+
+	util::box<int,2> pixelRegion = OffscreenRenderer::getPixelRegion(region, pixelsPerUnit);
+
+	if (pixelRegion.area() <= 0) {
+
+		std::cerr << "nothing to render for " << filename << std::endl;
+		return false;
+	}
+
+	std::cout << "rendering " << filename << " (" << pixelRegion.width() << "x" << pixelRegion.height() << " pixels)" << std::endl;
+
+	std::vector<sg_gui::skia_pixel_t> pixels(static_cast<std::size_t>(pixelRegion.width())*pixelRegion.height());
+	std::size_t rowBytes = pixelRegion.width()*sizeof(sg_gui::skia_pixel_t);
+
+	renderer.render(pixelRegion, pixelsPerUnit, &pixels[0], rowBytes);
+
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(pixelRegion.width(), pixelRegion.height()), rowBytes);
+	bitmap.setPixels(&pixels[0]);
+
+	if (!SkImageEncoder::EncodeFile(filename.c_str(), bitmap, SkImageEncoder::kPNG_Type, 100)) {
+
+		std::cerr << "could not write " << filename << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv) {
+
+	try {
+
+		util::ProgramOptions::init(argc, argv);
+		logger::LogManager::init();
+
+		if (!optionDocument) {
+
+			std::cerr << "usage: " << argv[0] << " --document <file> [--output <name>] [--dpi <dpi>] [--region \"minX minY maxX maxY\"]" << std::endl;
+			return 1;
+		}
+
+		std::shared_ptr<Document> document = readTextDocument(optionDocument.as<std::string>());
+
+		if (!document)
+			return 1;
+
+		// one document unit is one millimeter
+		double pixelsPerUnit = optionDpi.as<double>()/25.4;
+
+		OffscreenRenderer renderer(document);
+
+		std::string output = optionOutput.as<std::string>();
+		bool success = true;
+
+		if (optionRegion) {
+
+			std::istringstream values(optionRegion.as<std::string>());
+			double minX, minY, maxX, maxY;
+
+			if (!(values >> minX >> minY >> maxX >> maxY)) {
+
+				std::cerr << "invalid region '" << optionRegion.as<std::string>() << "'" << std::endl;
+				return 1;
+			}
+
+			success = renderToPng(renderer, util::box<DocumentPrecision,2>(minX, minY, maxX, maxY), pixelsPerUnit, output + ".png");
+
+		} else {
+
+			for (unsigned int i = 0; i < document->numPages(); i++) {
+
+				std::ostringstream filename;
+				filename << output << "_" << i << ".png";
+
+				success &= renderToPng(renderer, document->getPage(i).getPageBoundingBox(), pixelsPerUnit, filename.str());
+			}
+		}
+
+		return (success ? 0 : 1);
+
+	} catch (boost::exception& e) {
+
+		handleException(e, std::cerr);
+		return 1;
+	}
+}
+